@@ -18,23 +18,93 @@
 #define __ONIC_H__
 
 #include <linux/netdevice.h>
+#include <linux/cache.h>
+#include <linux/stddef.h>
 #include <linux/cpumask.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/net_tstamp.h>
 #include <net/xdp.h>
 
 #include "onic_hardware.h"
 
 #define ONIC_MAX_QUEUES			64
+/* per-function QDMA queue window: stack queues followed by XDP TX queues */
+#define ONIC_MAX_QDMA_QUEUES		(2 * ONIC_MAX_QUEUES)
 #define ONIC_MAX_QDMA_BUF_SIZE		PAGE_SIZE - XDP_PACKET_HEADROOM
 /* state bits */
 #define ONIC_ERROR_INTR			0
 #define ONIC_USER_INTR			1
+#define ONIC_CPUHP			2
 
 /* flag bits */
 #define ONIC_FLAG_MASTER_PF		0
+#define ONIC_FLAG_IOMMU			1	/* DMA goes through IOMMU translation */
 
 
-#define ONIC_SKB_BUFF 0
+#define ONIC_SKB_BUFF 0		/* linear part of an skb, dma_map_single() */
 #define ONIC_XDP_FRAME 1
+#define ONIC_SKB_FRAG 2		/* skb page fragment, skb_frag_dma_map() */
+#define ONIC_TX_NOMAP 3		/* TX slot, or part of a mapping owned by a later entry */
+
+/* Stack TX queues carry one slot of coherent memory per descriptor, used for
+ * the headers built by driver-side TSO and as a bounce buffer for packets up
+ * to the TX copybreak.
+ */
+#define ONIC_TX_SLOT_SIZE	128
+/* in IOMMU mode, copying more saves a map and an unmap, each an IOTLB
+ * operation, on more packets
+ */
+#define ONIC_TX_SLOT_SIZE_IOMMU	256
+
+/* RX buffers are a page each, with XDP headroom and build_skb() tailroom.  In
+ * IOMMU mode they are carved from higher-order pool pages, one IOMMU mapping
+ * covering 1 << ONIC_RX_PAGE_ORDER_IOMMU buffers.
+ */
+#define ONIC_RX_BUF_LEN		(PAGE_SIZE - XDP_PACKET_HEADROOM - \
+				 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+#define ONIC_RX_PAGE_ORDER_IOMMU	3
+/* GSO skbs with more segments are segmented by the stack instead */
+#define ONIC_TSO_MAX_SEGS	256
+/* worst-case descriptors taken by one skb: a header and up to two payload
+ * pieces per TSO segment, plus the fragment boundaries and a runt pad
+ */
+#define ONIC_TX_DESC_MAX	(2 * ONIC_TSO_MAX_SEGS + MAX_SKB_FRAGS + 2)
+/* a stopped TX queue is woken once this many descriptors are free */
+#define ONIC_TX_WAKE_THRESH	(2 * ONIC_TX_DESC_MAX)
+
+/* delay between a transmit and the reclaim of its descriptors */
+#define ONIC_TX_COALESCE_USECS_DEFAULT	50
+#define ONIC_TX_COALESCE_USECS_MAX	10000
+
+/* TX queue state bits */
+#define ONIC_TX_THROTTLED		0
+
+/* ndo_set_tx_maxrate token bucket: the credit a queue may build up while
+ * idle, one millisecond at the configured rate but at least a GSO skb
+ */
+#define ONIC_TX_RATE_BURST_NS		NSEC_PER_MSEC
+#define ONIC_TX_RATE_MIN_BURST		(64 * 1024)
+
+/* source of the 32-bit metadata word of H2C descriptors, handed to the
+ * user logic along with the packet; names in onic_sysfs.c
+ */
+enum onic_tx_meta {
+	ONIC_TX_META_LEN = 0,		/* packet length, the default */
+	ONIC_TX_META_MARK,		/* skb->mark */
+	ONIC_TX_META_PRIORITY,		/* skb->priority */
+	ONIC_TX_META_QUEUE,		/* QDMA queue ID */
+	ONIC_TX_META_XDP,		/* last 4 bytes of the XDP metadata */
+	ONIC_TX_META_MAX
+};
+
+/* mqprio traffic classes, one per 802.1p priority */
+#define ONIC_MAX_TC		8
+
+/* One per H2C descriptor.  For an skb spanning several descriptors, only the
+ * entry of the last descriptor holds the skb pointer.
+ */
 struct onic_tx_buffer {
 	union {
 		struct sk_buff *skb;
@@ -44,62 +114,138 @@ struct onic_tx_buffer {
 	u32 len;
 	u32 type;
 	u64 time_stamp;
+	/* wire bytes and packets of the skb, on its last descriptor only */
+	u32 bytes;
+	u16 packets;
 };
 
 struct onic_rx_buffer {
-	struct page *pg;
-	unsigned int offset;
+	struct page *pg;		/* head page of a pool fragment */
+	unsigned int offset;		/* of the packet data in pg */
 	u64 time_stamp;
 };
 
+/**
+ * struct onic_xdp_buff - XDP buffer wrapper used by the RX path
+ * @xdp: generic XDP buffer, must be the first member
+ * @cmpl: completion entry of the packet being processed
+ * @rx_ts: driver-side RX timestamp of the completion burst, in nanoseconds
+ *
+ * XDP metadata kfuncs receive a pointer to @xdp and cast it back to this
+ * structure to look up the per-packet RX context.
+ **/
+struct onic_xdp_buff {
+	struct xdp_buff xdp;
+	const struct qdma_c2h_cmpl *cmpl;
+	u64 rx_ts;
+};
+
 enum {
 	ONIC_XDP_PASS = 0,
 	ONIC_XDP_TX,
 	ONIC_XDP_REDIRECT,
-	ONIC_XDP_DROP
+	ONIC_XDP_DROP,
+	ONIC_XDP_ABORTED
 };
 /**
  * struct onic_ring - generic ring structure
+ *
+ * The indexes come first, so that the index state of a ring sits in one
+ * cache line with what the xmit path keeps next to it.
  **/
 struct onic_ring {
 	u16 count;		/* number of descriptors */
-	u8 *desc;		/* base address for descriptors */
-	u8 *wb;			/* descriptor writeback */
-	dma_addr_t dma_addr;	/* DMA address for descriptors */
-
 	u16 next_to_use;
 	u16 next_to_clean;
 	u8 color;
+	u8 *desc;		/* base address for descriptors */
+	u8 *wb;			/* descriptor writeback */
+	dma_addr_t dma_addr;	/* DMA address for descriptors */
 };
 
+/* Three sections, each starting a cache line, see the asserts below:
+ * read-mostly config, the producer state written by the xmit path (by the
+ * owning NAPI for XDP TX queues), and the reclaim side.  ring.next_to_clean
+ * is written on reclaim, but read by every transmit to size the free space,
+ * so it stays with the other indexes.
+ */
 struct onic_tx_queue {
 	struct net_device *netdev;
-	u16 qid;
-	DECLARE_BITMAP(state, 32);
-
 	struct onic_tx_buffer *buffer;
-	struct onic_ring ring;
 	struct onic_q_vector *vector;
+	u8 *slots;		/* tx_slot_size bytes per descriptor */
+	dma_addr_t slots_dma;
+	u16 qid;
+
+	/* producer */
+	struct onic_ring ring ____cacheline_aligned_in_smp;
+
+	/* stack queues only: ndo_set_tx_maxrate token bucket, updated under
+	 * the xmit lock.  An empty bucket stops the queue until rate_timer.
+	 */
+	u32 rate_mbps;			/* 0 when unlimited */
+	s64 rate_tokens;		/* bytes, negative once overdrawn */
+	u64 rate_last;			/* ktime_get_ns() of the last refill */
+
+	/* deferred doorbell, used when tx_db_batch is set */
+	spinlock_t db_lock;
+	u16 db_pidx;			/* ring head at the last packet boundary */
+	u16 db_rung;			/* last PIDX written to the doorbell */
+
+	/* consumer, atomics shared with the timers */
+	DECLARE_BITMAP(state, 32) ____cacheline_aligned_in_smp;
+
+	/* stack queues only: H2C queues raise no interrupt, completions are
+	 * reclaimed by a NAPI scheduled from a timer armed on transmit
+	 */
+	struct napi_struct napi;
+	struct hrtimer timer;
+	struct hrtimer rate_timer;
+	struct hrtimer db_timer;
 };
 
-/* Check cache line size */
+/* Only ever touched by the NAPI of the queue: the per-packet state first,
+ * then the setup-time config, then the structures with their own alignment.
+ */
 struct onic_rx_queue {
-	// 1st cache line
+	struct onic_rx_buffer *buffer ____cacheline_aligned_in_smp;
 	struct net_device *netdev;
+	struct page_pool *ppool;
 	u16 qid;
-	struct onic_rx_buffer *buffer;
-	struct onic_ring desc_ring;	//40 bytes
-	// 2nd cache line
+	struct onic_ring desc_ring;
 	struct onic_ring cmpl_ring;
-	struct onic_q_vector *vector;
-	struct page_pool *ppool;
+
+	struct onic_q_vector *vector ____cacheline_aligned_in_smp;
 	struct page_pool_params *pparam;
-	// 3rd cache line
-	struct xdp_rxq_info xdp_rxq;	//Internally cache aligned
-	// 4th cache line
-	struct napi_struct napi;
+
+	struct xdp_rxq_info xdp_rxq;	/* internally cacheline aligned */
+	struct napi_struct napi ____cacheline_aligned_in_smp;
 };
 
+#ifdef CONFIG_SMP
+#define ONIC_LINE(type, member)	(offsetof(type, member) / SMP_CACHE_BYTES)
+#define ONIC_LINE_END(type, member) \
+	((offsetofend(type, member) - 1) / SMP_CACHE_BYTES)
+
+/* each section starts a line of its own */
+static_assert(ONIC_LINE(struct onic_tx_queue, ring) >
+	      ONIC_LINE_END(struct onic_tx_queue, qid));
+static_assert(ONIC_LINE(struct onic_tx_queue, state) >
+	      ONIC_LINE_END(struct onic_tx_queue, db_rung));
+static_assert(ONIC_LINE(struct onic_rx_queue, vector) >
+	      ONIC_LINE_END(struct onic_rx_queue, cmpl_ring));
+static_assert(ONIC_LINE(struct onic_rx_queue, napi) >
+	      ONIC_LINE_END(struct onic_rx_queue, xdp_rxq));
+#if SMP_CACHE_BYTES >= 64
+/* a transmit writes one producer line, plus the reclaim timer it arms */
+static_assert(ONIC_LINE_END(struct onic_tx_queue, rate_last) ==
+	      ONIC_LINE(struct onic_tx_queue, ring));
+/* an RX packet touches two lines at most */
+static_assert(ONIC_LINE_END(struct onic_rx_queue, cmpl_ring) -
+	      ONIC_LINE(struct onic_rx_queue, buffer) < 2);
+#endif
+#endif
+
 struct onic_q_vector {
 	u16 vid;
 	struct onic_private *priv;
@@ -107,15 +253,66 @@ struct onic_q_vector {
 	int numa_node;
 };
 
+/**
+ * struct onic_xdp_stats - XDP verdict counters
+ *
+ * The field order matches the ethtool string table in onic_ethtool.c.
+ **/
 struct onic_xdp_stats {
-	u64 xdp_passed;
-	u64 xdp_dropped;
-	u64 xdp_redirected;
-	u64 xdp_txed;
-	u64 xdp_tx_dropped;
+	u64 xdp_pass;
+	u64 xdp_drop;
+	u64 xdp_tx;
 	u64 xdp_tx_errors;
+	u64 xdp_redirect;
+	u64 xdp_redirect_errors;
+	u64 xdp_aborted;
 };
 
+#define ONIC_XDP_STATS_LEN	(sizeof(struct onic_xdp_stats) / sizeof(u64))
+
+/**
+ * struct onic_rx_stats - per RX queue counters, written by its NAPI only
+ **/
+struct onic_rx_stats {
+	struct u64_stats_sync syncp;
+	u64 packets;
+	u64 bytes;
+	u64 alloc_fail;
+	struct onic_xdp_stats xdp;
+} ____cacheline_aligned_in_smp;
+
+/**
+ * struct onic_tx_stats - per TX queue counters, written under the queue xmit lock
+ **/
+struct onic_tx_stats {
+	struct u64_stats_sync syncp;
+	u64 packets;
+	u64 bytes;
+	u64 dropped;
+	u64 errors;
+	u64 dma_maps;			/* streaming mappings of skb data */
+} ____cacheline_aligned_in_smp;
+
+/**
+ * struct onic_tx_clean_stats - per TX queue reclaim counters, written by
+ * onic_tx_clean() only
+ **/
+struct onic_tx_clean_stats {
+	struct u64_stats_sync syncp;
+	u64 dma_unmaps;
+} ____cacheline_aligned_in_smp;
+
+/**
+ * struct onic_db_stats - doorbells rung on a QDMA H2C queue
+ *
+ * Written by whoever rings the doorbell: the xmit path or the NAPI owning an
+ * XDP TX queue, and the deferred doorbell timer under the queue's db_lock.
+ **/
+struct onic_db_stats {
+	struct u64_stats_sync syncp;
+	u64 doorbells;
+} ____cacheline_aligned_in_smp;
+
 /**
  * struct onic_private - OpenNIC driver private data
  **/
@@ -133,17 +330,41 @@ struct onic_private {
 	u16 num_rx_queues;
 
 	struct net_device *netdev;
-	struct rtnl_link_stats64 netdev_stats;
+	u32 tx_copybreak;		/* ETHTOOL_TX_COPYBREAK, read locklessly */
+	u32 tx_slot_size;		/* ONIC_TX_SLOT_SIZE{,_IOMMU} */
+	u8 rx_page_order;		/* of the RX page pool pages */
+	u32 tx_metadata;		/* enum onic_tx_meta, read locklessly */
+	/* ethtool tx-usecs of each TX queue, read locklessly */
+	u32 tx_coalesce_usecs[ONIC_MAX_QUEUES];
+	/* ndo_set_tx_maxrate of each TX queue in Mbps, 0 for unlimited */
+	u32 tx_maxrate[ONIC_MAX_QUEUES];
+	/* doorbell deferral: pending descriptors and deadline, 0 to disable */
+	u32 tx_db_batch;
+	u32 tx_db_usecs;
 	spinlock_t tx_lock;
 	spinlock_t rx_lock;
 
 	struct onic_q_vector *q_vector[ONIC_MAX_QUEUES];
 	struct onic_tx_queue *tx_queue[ONIC_MAX_QUEUES];
 	struct onic_rx_queue *rx_queue[ONIC_MAX_QUEUES];
+	/* one per RX queue, allocated while an XDP program is attached */
+	struct onic_tx_queue *xdp_tx_queue[ONIC_MAX_QUEUES];
+
+	/* refreshes IRQ affinity and XPS maps on CPU hotplug */
+	struct hlist_node cpuhp_node;
+	struct work_struct affinity_work;
 
 	struct onic_hardware hw;
-	struct bpf_prog *prog;
-	struct onic_xdp_stats xdp_stats; // Make it per cpu to avoid contention
+	struct bpf_prog *prog;		/* swapped with xchg(), read once per NAPI poll */
+
+	/* indexed by queue id, kept across ifdown so counters stay monotonic */
+	struct onic_rx_stats rx_stats[ONIC_MAX_QUEUES];
+	struct onic_tx_stats tx_stats[ONIC_MAX_QUEUES];
+	struct onic_tx_clean_stats tx_clean_stats[ONIC_MAX_QUEUES];
+	/* RX chunks mapped by page pools already destroyed, under rtnl */
+	u64 rx_dma_maps[ONIC_MAX_QUEUES];
+	/* indexed by QDMA queue ID, stack TX queues then XDP TX queues */
+	struct onic_db_stats db_stats[ONIC_MAX_QDMA_QUEUES];
 };
 
 #endif
@@ -21,47 +21,15 @@
 #include <linux/skbuff.h>
 
 /**
- * get_trailing_zeros - Get the number of trailing zeros
- * @x: input number
+ * FIELD_SHIFT - position of the lowest bit set in a non-zero mask
  *
- * Returns the number of trailing 0s in x, starting at LSB.  For GCC compiler,
- * it simply calls the __builtin_ffsll function.
+ * Register and descriptor masks are compile-time constants, so the builtin
+ * folds to an immediate and FIELD_SET/BITFIELD_GET reduce to a shift and a
+ * mask.  Masks only known at runtime cost a single bit scan instruction.
  **/
-static inline u8 get_trailing_zeros(u64 x)
-{
-#ifdef GCC_COMPILER
-	return (__builtin_ffsll(x) - 1);
-#else
-	u8 n = 1;
-
-	if ((x & 0xFFFFFFFF) == 0) {
-		n = n + 32;
-		x = x >> 32;
-	}
-	if ((x & 0x0000FFFF) == 0) {
-		n = n + 16;
-		x = x >> 16;
-	}
-	if ((x & 0x000000FF) == 0) {
-		n = n + 8;
-		x = x >> 8;
-	}
-	if ((x & 0x0000000F) == 0) {
-		n = n + 4;
-		x = x >> 4;
-	}
-	if ((x & 0x00000003) == 0) {
-		n = n + 2;
-		x = x >> 2;
-	}
-
-	return n - (x & 1);
-#endif
-}
-
-#define FIELD_SHIFT(mask)	get_trailing_zeros(mask)
-#define FIELD_SET(mask, val)	(((u64)(val) << FIELD_SHIFT(mask)) & mask)
-#define BITFIELD_GET(mask, reg)	((reg & mask) >> FIELD_SHIFT(mask))
+#define FIELD_SHIFT(mask)	__builtin_ctzll(mask)
+#define FIELD_SET(mask, val)	(((u64)(val) << FIELD_SHIFT(mask)) & (mask))
+#define BITFIELD_GET(mask, reg)	(((reg) & (mask)) >> FIELD_SHIFT(mask))
 
 /**
  * print_raw_data - print raw data to kernel log
@@ -17,6 +17,12 @@
 #include <linux/pci.h>
 #include <linux/netdevice.h>
 #include <linux/ethtool.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
 
 #include "onic.h"
 #include "onic_register.h"
@@ -222,9 +228,46 @@ static const struct onic_stats onic_gstrings_stats[] = {
           CMAC_OFFSET_STAT_RX_TRUNCATED(1)),
 };
 
-#define ONIC_QUEUE_STATS_LEN 0
+/* same order as the fields of struct onic_xdp_stats */
+static const char onic_gstrings_xdp_stats[][ETH_GSTRING_LEN] = {
+    "xdp_pass",
+    "xdp_drop",
+    "xdp_tx",
+    "xdp_tx_errors",
+    "xdp_redirect",
+    "xdp_redirect_errors",
+    "xdp_aborted",
+};
+
+static_assert(ARRAY_SIZE(onic_gstrings_xdp_stats) == ONIC_XDP_STATS_LEN);
+
+/* rx<N>_dma_maps needs the page pool stats, and is only exact while pool
+ * pages are carved into chunks: the pool then counts every page it maps as a
+ * high order allocation.  rx_page_order is fixed at probe.
+ */
+static bool onic_has_rx_dma_maps(const struct onic_private *priv)
+{
+#ifdef CONFIG_PAGE_POOL_STATS
+    return priv->rx_page_order > 0;
+#else
+    return false;
+#endif
+}
+
+/* per RX queue: packets, bytes, the XDP counters, XDP TX doorbells, and DMA
+ * maps when available
+ */
+#define ONIC_RX_QUEUE_STATS_LEN(priv) \
+	(3 + ONIC_XDP_STATS_LEN + onic_has_rx_dma_maps(priv))
+/* per TX queue: packets, bytes, doorbells, DMA maps and unmaps */
+#define ONIC_TX_QUEUE_STATS_LEN	5
+#define ONIC_QUEUE_STATS_LEN(priv) \
+	(ONIC_XDP_STATS_LEN + \
+	 (priv)->num_rx_queues * ONIC_RX_QUEUE_STATS_LEN(priv) + \
+	 (priv)->num_tx_queues * ONIC_TX_QUEUE_STATS_LEN)
 #define ONIC_GLOBAL_STATS_LEN ARRAY_SIZE(onic_gstrings_stats)
-#define ONIC_STATS_LEN        (ONIC_GLOBAL_STATS_LEN + ONIC_QUEUE_STATS_LEN)
+#define ONIC_STATS_LEN(priv) \
+	(ONIC_GLOBAL_STATS_LEN + ONIC_QUEUE_STATS_LEN(priv))
 
 static void onic_get_drvinfo(struct net_device *netdev,
 			     struct ethtool_drvinfo *drvinfo)
@@ -261,6 +304,51 @@ static u32 onic_get_link(struct net_device *netdev)
     return (carrier_ok && val);
 }
 
+static u64 onic_read_doorbells(struct onic_private *priv, u16 qid)
+{
+    const struct onic_db_stats *dbs = &priv->db_stats[qid];
+    unsigned int start;
+    u64 doorbells;
+
+    do {
+        start = u64_stats_fetch_begin(&dbs->syncp);
+        doorbells = dbs->doorbells;
+    } while (u64_stats_fetch_retry(&dbs->syncp, start));
+
+    return doorbells;
+}
+
+static u64 onic_read_dma_unmaps(struct onic_private *priv, u16 qid)
+{
+    const struct onic_tx_clean_stats *cs = &priv->tx_clean_stats[qid];
+    unsigned int start;
+    u64 unmaps;
+
+    do {
+        start = u64_stats_fetch_begin(&cs->syncp);
+        unmaps = cs->dma_unmaps;
+    } while (u64_stats_fetch_retry(&cs->syncp, start));
+
+    return unmaps;
+}
+
+/* pool page chunks mapped for RX queue qid since probe, each mapped once for
+ * its whole life in the pool; recycled chunks are not counted again.  Under
+ * rtnl, like the open and stop paths that create and destroy the pool.
+ */
+static u64 onic_read_rx_dma_maps(struct onic_private *priv, u16 qid)
+{
+    u64 maps = priv->rx_dma_maps[qid];
+#ifdef CONFIG_PAGE_POOL_STATS
+    const struct onic_rx_queue *q = priv->rx_queue[qid];
+    struct page_pool_stats pps = {};
+
+    if (q && page_pool_get_stats(q->ppool, &pps))
+        maps += pps.alloc_stats.slow_high_order;
+#endif
+    return maps;
+}
+
 static void onic_get_ethtool_stats(struct net_device *netdev,
             struct ethtool_stats /*__always_unused*/ *stats,
             u64 *data)
@@ -268,7 +356,8 @@ static void onic_get_ethtool_stats(struct net_device *netdev,
     struct onic_private *priv = netdev_priv(netdev);
     struct onic_hardware *hw = &priv->hw;
     struct pci_dev *pdev = priv->pdev;
-    int i;
+    u64 *totals;
+    int i, qid;
     u16 func_id;
     u32 off;
 
@@ -288,34 +377,251 @@ static void onic_get_ethtool_stats(struct net_device *netdev,
         else off = onic_gstrings_stats[i].stat1_offset;
         data[i] = onic_read_reg(hw,off);
     }
+    data += ONIC_GLOBAL_STATS_LEN;
+
+    /* XDP totals first, the per-queue breakdown follows */
+    totals = data;
+    memset(totals, 0, ONIC_XDP_STATS_LEN * sizeof(u64));
+    data += ONIC_XDP_STATS_LEN;
+
+    for (qid = 0; qid < priv->num_rx_queues; qid++) {
+        const struct onic_rx_stats *rs = &priv->rx_stats[qid];
+        struct onic_xdp_stats xdp;
+        const u64 *xdp_data = (const u64 *)&xdp;
+        unsigned int start;
 
-    return;
+        do {
+            start = u64_stats_fetch_begin(&rs->syncp);
+            data[0] = rs->packets;
+            data[1] = rs->bytes;
+            xdp = rs->xdp;
+        } while (u64_stats_fetch_retry(&rs->syncp, start));
+        data += 2;
+
+        for (i = 0; i < ONIC_XDP_STATS_LEN; i++) {
+            data[i] = xdp_data[i];
+            totals[i] += xdp_data[i];
+        }
+        data += ONIC_XDP_STATS_LEN;
+
+        /* the XDP TX queue of RX queue qid follows the stack TX queues */
+        *data++ = onic_read_doorbells(priv, priv->num_tx_queues + qid);
+        if (onic_has_rx_dma_maps(priv))
+            *data++ = onic_read_rx_dma_maps(priv, qid);
+    }
+
+    for (qid = 0; qid < priv->num_tx_queues; qid++) {
+        const struct onic_tx_stats *ts = &priv->tx_stats[qid];
+        unsigned int start;
+
+        do {
+            start = u64_stats_fetch_begin(&ts->syncp);
+            data[0] = ts->packets;
+            data[1] = ts->bytes;
+            data[3] = ts->dma_maps;
+        } while (u64_stats_fetch_retry(&ts->syncp, start));
+        data[2] = onic_read_doorbells(priv, qid);
+        data[4] = onic_read_dma_unmaps(priv, qid);
+        data += ONIC_TX_QUEUE_STATS_LEN;
+    }
 }
 
 static void onic_get_strings(struct net_device *netdev, u32 stringset,
 			      u8 *data)
 {
+	struct onic_private *priv = netdev_priv(netdev);
 	u8 *p = data;
-	int i;
+	int i, qid;
+
+    if (stringset != ETH_SS_STATS)
+        return;
 
     for (i = 0; i < ONIC_GLOBAL_STATS_LEN; i++) {
         memcpy(p, onic_gstrings_stats[i].stat_string,
             ETH_GSTRING_LEN);
         p += ETH_GSTRING_LEN;
     }
+
+    for (i = 0; i < ONIC_XDP_STATS_LEN; i++) {
+        memcpy(p, onic_gstrings_xdp_stats[i], ETH_GSTRING_LEN);
+        p += ETH_GSTRING_LEN;
+    }
+
+    for (qid = 0; qid < priv->num_rx_queues; qid++) {
+        snprintf(p, ETH_GSTRING_LEN, "rx%d_packets", qid);
+        p += ETH_GSTRING_LEN;
+        snprintf(p, ETH_GSTRING_LEN, "rx%d_bytes", qid);
+        p += ETH_GSTRING_LEN;
+        for (i = 0; i < ONIC_XDP_STATS_LEN; i++) {
+            snprintf(p, ETH_GSTRING_LEN, "rx%d_%s", qid,
+                     onic_gstrings_xdp_stats[i]);
+            p += ETH_GSTRING_LEN;
+        }
+        snprintf(p, ETH_GSTRING_LEN, "rx%d_xdp_tx_doorbells", qid);
+        p += ETH_GSTRING_LEN;
+        if (onic_has_rx_dma_maps(priv)) {
+            snprintf(p, ETH_GSTRING_LEN, "rx%d_dma_maps", qid);
+            p += ETH_GSTRING_LEN;
+        }
+    }
+
+    for (qid = 0; qid < priv->num_tx_queues; qid++) {
+        snprintf(p, ETH_GSTRING_LEN, "tx%d_packets", qid);
+        p += ETH_GSTRING_LEN;
+        snprintf(p, ETH_GSTRING_LEN, "tx%d_bytes", qid);
+        p += ETH_GSTRING_LEN;
+        snprintf(p, ETH_GSTRING_LEN, "tx%d_doorbells", qid);
+        p += ETH_GSTRING_LEN;
+        snprintf(p, ETH_GSTRING_LEN, "tx%d_dma_maps", qid);
+        p += ETH_GSTRING_LEN;
+        snprintf(p, ETH_GSTRING_LEN, "tx%d_dma_unmaps", qid);
+        p += ETH_GSTRING_LEN;
+    }
 }
 
 static int onic_get_sset_count(struct net_device *netdev, int sset)
 {
-    return ONIC_STATS_LEN;
+    const struct onic_private *priv = netdev_priv(netdev);
+
+    if (sset != ETH_SS_STATS)
+        return -EOPNOTSUPP;
+
+    return ONIC_STATS_LEN(priv);
+}
+
+static int onic_get_tunable(struct net_device *netdev,
+			    const struct ethtool_tunable *tuna, void *data)
+{
+    struct onic_private *priv = netdev_priv(netdev);
+
+    switch (tuna->id) {
+    case ETHTOOL_TX_COPYBREAK:
+        *(u32 *)data = READ_ONCE(priv->tx_copybreak);
+        return 0;
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+static int onic_set_tunable(struct net_device *netdev,
+			    const struct ethtool_tunable *tuna,
+			    const void *data)
+{
+    struct onic_private *priv = netdev_priv(netdev);
+    u32 val;
+
+    switch (tuna->id) {
+    case ETHTOOL_TX_COPYBREAK:
+        val = *(const u32 *)data;
+        /* copied packets must fit in a TX slot */
+        if (val > priv->tx_slot_size)
+            return -EINVAL;
+        WRITE_ONCE(priv->tx_copybreak, val);
+        return 0;
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int onic_get_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_ec,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_get_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+    struct onic_private *priv = netdev_priv(netdev);
+
+    ec->tx_coalesce_usecs = READ_ONCE(priv->tx_coalesce_usecs[0]);
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int onic_set_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_ec,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_set_coalesce(struct net_device *netdev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+    struct onic_private *priv = netdev_priv(netdev);
+    int qid;
+
+    if (ec->tx_coalesce_usecs > ONIC_TX_COALESCE_USECS_MAX)
+        return -EINVAL;
+
+    /* picked up the next time a reclaim timer is armed */
+    for (qid = 0; qid < ONIC_MAX_QUEUES; qid++)
+        WRITE_ONCE(priv->tx_coalesce_usecs[qid], ec->tx_coalesce_usecs);
+    return 0;
+}
+
+/* per-queue settings let each mqprio traffic class have its own moderation */
+static int onic_get_per_queue_coalesce(struct net_device *netdev, u32 queue,
+				       struct ethtool_coalesce *ec)
+{
+    struct onic_private *priv = netdev_priv(netdev);
+
+    if (queue >= priv->num_tx_queues)
+        return -EINVAL;
+
+    ec->tx_coalesce_usecs = READ_ONCE(priv->tx_coalesce_usecs[queue]);
+    return 0;
+}
+
+static int onic_set_per_queue_coalesce(struct net_device *netdev, u32 queue,
+				       struct ethtool_coalesce *ec)
+{
+    struct onic_private *priv = netdev_priv(netdev);
+
+    if (queue >= priv->num_tx_queues)
+        return -EINVAL;
+    if (ec->tx_coalesce_usecs > ONIC_TX_COALESCE_USECS_MAX)
+        return -EINVAL;
+
+    WRITE_ONCE(priv->tx_coalesce_usecs[queue], ec->tx_coalesce_usecs);
+    return 0;
+}
+
+/* there is no PHC, the stamps are software ones taken by the driver */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+static int onic_get_ts_info(struct net_device *netdev,
+			    struct kernel_ethtool_ts_info *info)
+#else
+static int onic_get_ts_info(struct net_device *netdev,
+			    struct ethtool_ts_info *info)
+#endif
+{
+    info->so_timestamping = SOF_TIMESTAMPING_TX_SOFTWARE |
+                            SOF_TIMESTAMPING_RX_SOFTWARE |
+                            SOF_TIMESTAMPING_SOFTWARE;
+    info->phc_index = -1;
+    info->tx_types = BIT(HWTSTAMP_TX_OFF);
+    info->rx_filters = BIT(HWTSTAMP_FILTER_NONE);
+    return 0;
 }
 
 static const struct ethtool_ops onic_ethtool_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+    .supported_coalesce_params = ETHTOOL_COALESCE_TX_USECS,
+#endif
     .get_drvinfo       = onic_get_drvinfo,
     .get_link          = onic_get_link,
     .get_ethtool_stats = onic_get_ethtool_stats,
     .get_strings       = onic_get_strings,
     .get_sset_count    = onic_get_sset_count,
+    .get_tunable       = onic_get_tunable,
+    .set_tunable       = onic_set_tunable,
+    .get_coalesce      = onic_get_coalesce,
+    .set_coalesce      = onic_set_coalesce,
+    .get_per_queue_coalesce = onic_get_per_queue_coalesce,
+    .set_per_queue_coalesce = onic_set_per_queue_coalesce,
+    .get_ts_info       = onic_get_ts_info,
 };
 
 void onic_set_ethtool_ops(struct net_device *netdev)
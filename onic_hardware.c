@@ -246,8 +246,10 @@ int onic_init_hardware(struct onic_private *priv)
 		return -ENOMEM;
 
 	func_id = PCI_FUNC(pdev->devfn);
-	qbase = func_id * ONIC_MAX_QUEUES;
-	qmax = max(priv->num_tx_queues, priv->num_rx_queues);
+	qbase = func_id * ONIC_MAX_QDMA_QUEUES;
+	/* reserve one XDP TX queue per RX queue after the stack TX queues */
+	qmax = max(priv->num_tx_queues, priv->num_rx_queues) +
+		priv->num_rx_queues;
 
 	/* initialize QDMA function map context */
 	memset(&fmap_ctxt, 0, sizeof(struct qdma_fmap_ctxt));
@@ -267,7 +269,7 @@ int onic_init_hardware(struct onic_private *priv)
 
 	/* initialize indirection table */
 	for (i = 0; i < 128; ++i) {
-		u32 val = (i % qmax) & 0x0000FFFF;
+		u32 val = (i % priv->num_rx_queues) & 0x0000FFFF;
 		u32 offset = QDMA_FUNC_OFFSET_INDIR_TABLE(func_id, i);
 		onic_write_reg(hw, offset, val);
 	}
@@ -536,13 +538,15 @@ static void onic_qdma_set_q_pidx(unsigned long qdma, u16 qid,
 		return;
 
 	if (dir == QDMA_C2H)
-		offset = QDMA_OFFSET_DMAP_SEL_C2H_DESC_PIDX + (qid * 16);
+		offset = QDMA_OFFSET_DMAP_SEL_C2H_DESC_PIDX +
+			 (qid * QDMA_DMAP_SEL_QUEUE_STRIDE);
 	else
-		offset = QDMA_OFFSET_DMAP_SEL_H2C_DESC_PIDX + (qid * 16);
+		offset = QDMA_OFFSET_DMAP_SEL_H2C_DESC_PIDX +
+			 (qid * QDMA_DMAP_SEL_QUEUE_STRIDE);
 
 	val = (FIELD_SET(QDMA_DMAP_SEL_DESC_PIDX_MASK, pidx) |
 	       FIELD_SET(QDMA_DMAP_SEL_DESC_IRQ_ARM_MASK, irq_arm));
-	qdma_write_reg(qdev, offset, val);
+	qdma_write_db(qdev, offset, val);
 }
 
 void onic_set_tx_head(unsigned long qdma, u16 qid, u16 head)
@@ -578,7 +582,8 @@ static void onic_qdma_set_cmpl_cidx(unsigned long qdma, u16 qid, u16 cidx,
 	if (qid < 0)
 		return;
 
-	offset = QDMA_OFFSET_DMAP_SEL_CMPL_CIDX + (qid * 16);
+	offset = QDMA_OFFSET_DMAP_SEL_CMPL_CIDX +
+		 (qid * QDMA_DMAP_SEL_QUEUE_STRIDE);
 
 	val = (FIELD_SET(QDMA_DMAP_SEL_CMPL_CIDX_MASK, cidx) |
 	       FIELD_SET(QDMA_DMAP_SEL_CMPL_COUNTER_IDX_MASK, counter_idx) |
@@ -586,7 +591,7 @@ static void onic_qdma_set_cmpl_cidx(unsigned long qdma, u16 qid, u16 cidx,
 	       FIELD_SET(QDMA_DMAP_SEL_CMPL_TRIG_MODE_MASK, trig_mode) |
 	       FIELD_SET(QDMA_DMAP_SEL_CMPL_STAT_EN_MASK, stat_en) |
 	       FIELD_SET(QDMA_DMAP_SEL_CMPL_IRQ_ARM_MASK, irq_arm));
-	qdma_write_reg(qdev, offset, val);
+	qdma_write_db(qdev, offset, val);
 }
 
 void onic_set_completion_tail(unsigned long qdma, u16 qid, u16 tail, u8 irq_arm)
@@ -15,6 +15,10 @@
  * the file called "COPYING".
  */
 #include <linux/pci.h>
+#include <linux/interrupt.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/version.h>
 
 #include "onic_lib.h"
 #include "onic.h"
@@ -82,6 +86,11 @@ static void onic_clear_q_vector(struct onic_private *priv, u16 vid)
 
 	if (!vec)
 		return;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	irq_update_affinity_hint(pci_irq_vector(priv->pdev, vid), NULL);
+#else
+	irq_set_affinity_hint(pci_irq_vector(priv->pdev, vid), NULL);
+#endif
 	free_irq(pci_irq_vector(priv->pdev, vid), vec);
 	kfree(vec);
 }
@@ -116,10 +125,8 @@ static int onic_init_q_vector(struct onic_private *priv, u16 vid)
 		return rv;
 	}
 
-	/* setup affinity mask and node */
-	/* cpu = vid % num_online_cpus(); */
-	/* cpumask_set_cpu(cpu, &vec->affinity_mask); */
-	/* vec->numa_node = node; */
+	/* affinity mask and node are set up by onic_update_affinity() */
+	vec->numa_node = NUMA_NO_NODE;
 
 	dev_info(&pdev->dev, "Setup IRQ vector %d with name %s",
 		 pci_irq_vector(pdev, vid), name);
@@ -264,3 +271,121 @@ void onic_clear_interrupt(struct onic_private *priv)
 	while (vid--)
 		onic_clear_q_vector(priv, vid);
 }
+
+/* dynamic hotplug state shared by all OpenNIC devices */
+static enum cpuhp_state onic_cpuhp_state = CPUHP_INVALID;
+
+void onic_update_affinity(struct onic_private *priv)
+{
+	int node = dev_to_node(&priv->pdev->dev);
+	struct onic_q_vector *vec;
+	int cpu, rv;
+	u16 vid, qid;
+
+	/* waits for a hotplug operation in progress to complete */
+	cpus_read_lock();
+	for (vid = 0; vid < priv->num_q_vectors; ++vid) {
+		vec = priv->q_vector[vid];
+		if (!vec)
+			continue;
+
+		cpu = cpumask_local_spread(vid, node);
+		cpumask_clear(&vec->affinity_mask);
+		cpumask_set_cpu(cpu, &vec->affinity_mask);
+		vec->numa_node = cpu_to_node(cpu);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		irq_set_affinity_and_hint(pci_irq_vector(priv->pdev, vid),
+					  &vec->affinity_mask);
+#else
+		irq_set_affinity_hint(pci_irq_vector(priv->pdev, vid),
+				      &vec->affinity_mask);
+#endif
+	}
+	cpus_read_unlock();
+
+	for (qid = 0; qid < priv->num_tx_queues; ++qid) {
+		vec = priv->q_vector[qid % priv->num_q_vectors];
+		if (!vec)
+			continue;
+
+		rv = netif_set_xps_queue(priv->netdev, &vec->affinity_mask, qid);
+		if (rv < 0)
+			netdev_warn(priv->netdev,
+				    "Failed to set XPS map of TX queue %d, err = %d",
+				    qid, rv);
+	}
+}
+
+static void onic_affinity_work(struct work_struct *work)
+{
+	struct onic_private *priv =
+		container_of(work, struct onic_private, affinity_work);
+
+	onic_update_affinity(priv);
+}
+
+/**
+ * onic_cpuhp_event - CPU online and offline callback
+ * @cpu: CPU being brought up or down
+ * @node: hotplug instance of the device
+ *
+ * Runs from the hotplug thread while the CPU is still in transit, so the
+ * mapping is recomputed from a work item once the operation has completed.
+ **/
+static int onic_cpuhp_event(unsigned int cpu, struct hlist_node *node)
+{
+	struct onic_private *priv =
+		hlist_entry(node, struct onic_private, cpuhp_node);
+
+	schedule_work(&priv->affinity_work);
+	return 0;
+}
+
+int onic_register_cpuhp(void)
+{
+	int rv;
+
+	rv = cpuhp_setup_state_multi(CPUHP_AP_ONLINE_DYN, "net/onic:online",
+				     onic_cpuhp_event, onic_cpuhp_event);
+	if (rv < 0)
+		return rv;
+
+	onic_cpuhp_state = rv;
+	return 0;
+}
+
+void onic_unregister_cpuhp(void)
+{
+	if (onic_cpuhp_state == CPUHP_INVALID)
+		return;
+
+	cpuhp_remove_multi_state(onic_cpuhp_state);
+	onic_cpuhp_state = CPUHP_INVALID;
+}
+
+int onic_init_affinity(struct onic_private *priv)
+{
+	int rv;
+
+	INIT_WORK(&priv->affinity_work, onic_affinity_work);
+	onic_update_affinity(priv);
+
+	rv = cpuhp_state_add_instance_nocalls(onic_cpuhp_state,
+					      &priv->cpuhp_node);
+	if (rv < 0)
+		return rv;
+
+	set_bit(ONIC_CPUHP, priv->state);
+	return 0;
+}
+
+void onic_clear_affinity(struct onic_private *priv)
+{
+	if (!test_and_clear_bit(ONIC_CPUHP, priv->state))
+		return;
+
+	cpuhp_state_remove_instance_nocalls(onic_cpuhp_state,
+					    &priv->cpuhp_node);
+	cancel_work_sync(&priv->affinity_work);
+}
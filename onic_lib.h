@@ -47,4 +47,41 @@ int onic_init_interrupt(struct onic_private *priv);
  **/
 void onic_clear_interrupt(struct onic_private *priv);
 
+/**
+ * onic_register_cpuhp - register the driver's CPU hotplug state
+ *
+ * Return 0 on success, negative on failure
+ **/
+int onic_register_cpuhp(void);
+
+/**
+ * onic_unregister_cpuhp - remove the driver's CPU hotplug state
+ **/
+void onic_unregister_cpuhp(void);
+
+/**
+ * onic_update_affinity - spread queue vectors over the online CPUs
+ * @priv: pointer to driver private data
+ *
+ * Vector i is pinned to the i-th online CPU, starting from the device's NUMA
+ * node, and the TX queue of each queue pair gets an XPS map with that same
+ * CPU.  Transmit then runs on the CPU that also polls the RX queue.
+ **/
+void onic_update_affinity(struct onic_private *priv);
+
+/**
+ * onic_init_affinity - set up IRQ affinity and XPS maps of the queue pairs
+ * @priv: pointer to driver private data
+ *
+ * The mapping is recomputed whenever a CPU goes online or offline.  Return 0
+ * on success, negative on failure
+ **/
+int onic_init_affinity(struct onic_private *priv);
+
+/**
+ * onic_clear_affinity - stop tracking CPU hotplug events for the device
+ * @priv: pointer to driver private data
+ **/
+void onic_clear_affinity(struct onic_private *priv);
+
 #endif
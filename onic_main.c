@@ -22,6 +22,8 @@
 #include <linux/etherdevice.h>
 #include <linux/netdevice.h>
 #include <linux/moduleparam.h>
+#include <linux/iommu.h>
+#include <linux/version.h>
 
 #include "onic.h"
 #include "onic_hardware.h"
@@ -51,6 +53,21 @@ MODULE_VERSION(DRV_VER);
 static int RS_FEC_ENABLED=1;
 module_param(RS_FEC_ENABLED, int, 0644);
 
+static unsigned int tx_db_batch;
+module_param(tx_db_batch, uint, 0444);
+MODULE_PARM_DESC(tx_db_batch,
+		 "Defer TX doorbells until this many descriptors are pending (0: ring for every batch from the stack)");
+
+static unsigned int tx_db_usecs = 4;
+module_param(tx_db_usecs, uint, 0444);
+MODULE_PARM_DESC(tx_db_usecs,
+		 "Longest delay of a deferred TX doorbell, in microseconds");
+
+static int iommu_mode = -1;
+module_param(iommu_mode, int, 0444);
+MODULE_PARM_DESC(iommu_mode,
+		 "Keep DMA mappings few and long-lived for an IOMMU: -1 when the device is translated, 0 off, 1 on");
+
 #ifdef CMS_SUPPORT
 extern int xocl_init_xmc(void);
 extern void xocl_fini_xmc(void);
@@ -127,14 +144,33 @@ static const struct net_device_ops onic_netdev_ops = {
 	.ndo_open = onic_open_netdev,
 	.ndo_stop = onic_stop_netdev,
 	.ndo_start_xmit = onic_xmit_frame,
+	.ndo_features_check = onic_features_check,
 	.ndo_set_mac_address = onic_set_mac_address,
 	.ndo_do_ioctl = onic_do_ioctl,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	/* SIOC[GS]HWTSTAMP no longer reach ndo_do_ioctl */
+	.ndo_eth_ioctl = onic_do_ioctl,
+#endif
 	.ndo_change_mtu = onic_change_mtu,
 	.ndo_get_stats64 = onic_get_stats64,
 	.ndo_bpf = onic_xdp,
+	.ndo_setup_tc = onic_setup_tc,
+	.ndo_set_tx_maxrate = onic_set_tx_maxrate,
 };
 
 extern void onic_set_ethtool_ops(struct net_device *netdev);
+extern const struct attribute_group onic_attr_group;
+/**
+ * onic_iommu_translated - whether DMA of a device goes through IOMMU page
+ * tables, which makes every map and unmap an IOTLB operation
+ * @pdev: pointer to PCI device
+ **/
+static bool onic_iommu_translated(struct pci_dev *pdev)
+{
+	struct iommu_domain *dom = iommu_get_domain_for_dev(&pdev->dev);
+
+	return dom && dom->type != IOMMU_DOMAIN_IDENTITY;
+}
 
 /**
  * onic_probe - Probe and initialize PCI device
@@ -149,7 +185,7 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	struct onic_private *priv;
 	struct sockaddr saddr;
 	char dev_name[IFNAMSIZ];
-	int rv;
+	int i, rv;
 #ifdef CMS_SUPPORT
         static int xmc_init=0;
 #endif
@@ -194,7 +230,25 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 	SET_NETDEV_DEV(netdev, &pdev->dev);
 	netdev->netdev_ops = &onic_netdev_ops;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	netdev->xdp_metadata_ops = &onic_xdp_metadata_ops;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+	netdev->stat_ops = &onic_stat_ops;
+#endif
 	onic_set_ethtool_ops(netdev);
+	netdev->sysfs_groups[0] = &onic_attr_group;
+
+	/* Every skb fragment gets its own H2C descriptor.  The shell has no
+	 * checksum or segmentation offload: TSO/USO is done in the xmit path,
+	 * which also fills in the checksums the stack leaves to the device.
+	 */
+	netdev->hw_features |= NETIF_F_SG | NETIF_F_IP_CSUM |
+			       NETIF_F_IPV6_CSUM | NETIF_F_TSO | NETIF_F_TSO6;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	netdev->hw_features |= NETIF_F_GSO_UDP_L4;
+#endif
+	netdev->features |= netdev->hw_features | NETIF_F_HIGHDMA;
 
 	snprintf(dev_name, IFNAMSIZ, "onic%ds%df%d",
 		 pdev->bus->number,
@@ -211,6 +265,22 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 	memset(priv, 0, sizeof(struct onic_private));
 	priv->RS_FEC = RS_FEC_ENABLED;
+	if (iommu_mode > 0 || (iommu_mode < 0 && onic_iommu_translated(pdev))) {
+		dev_info(&pdev->dev, "IOMMU mode");
+		set_bit(ONIC_FLAG_IOMMU, priv->flags);
+	}
+	if (test_bit(ONIC_FLAG_IOMMU, priv->flags)) {
+		priv->tx_slot_size = ONIC_TX_SLOT_SIZE_IOMMU;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+		/* carving pool pages needs page_pool_dev_alloc_frag() */
+		priv->rx_page_order = ONIC_RX_PAGE_ORDER_IOMMU;
+#endif
+	} else {
+		priv->tx_slot_size = ONIC_TX_SLOT_SIZE;
+	}
+	priv->tx_copybreak = priv->tx_slot_size;
+	priv->tx_db_batch = tx_db_batch;
+	priv->tx_db_usecs = tx_db_usecs;
 
 	if (PCI_FUNC(pdev->devfn) == 0) {
 		dev_info(&pdev->dev, "device is a master PF");
@@ -220,6 +290,14 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	priv->netdev = netdev;
 	spin_lock_init(&priv->tx_lock);
 	spin_lock_init(&priv->rx_lock);
+	for (i = 0; i < ONIC_MAX_QUEUES; i++) {
+		priv->tx_coalesce_usecs[i] = ONIC_TX_COALESCE_USECS_DEFAULT;
+		u64_stats_init(&priv->rx_stats[i].syncp);
+		u64_stats_init(&priv->tx_stats[i].syncp);
+		u64_stats_init(&priv->tx_clean_stats[i].syncp);
+	}
+	for (i = 0; i < ONIC_MAX_QDMA_QUEUES; i++)
+		u64_stats_init(&priv->db_stats[i].syncp);
 
 	rv = onic_init_capacity(priv);
 	if (rv < 0) {
@@ -248,6 +326,12 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 		goto clear_interrupt;
 	}
 
+	rv = onic_init_affinity(priv);
+	if (rv < 0) {
+		dev_err(&pdev->dev, "onic_init_affinity, err = %d", rv);
+		goto unregister_netdev;
+	}
+
 	pci_set_drvdata(pdev, priv);
 	netif_carrier_off(netdev);
 
@@ -263,6 +347,8 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 	return 0;
 
+unregister_netdev:
+	unregister_netdev(netdev);
 clear_interrupt:
 	onic_clear_interrupt(priv);
 clear_hardware:
@@ -290,6 +376,7 @@ static void onic_remove(struct pci_dev *pdev)
         static int xmc_remove=0;
 #endif
 
+	onic_clear_affinity(priv);
 	unregister_netdev(priv->netdev);
 
 	onic_clear_interrupt(priv);
@@ -333,14 +420,25 @@ static struct pci_driver pci_driver = {
 
 static int __init onic_init_module(void)
 {
+	int rv;
+
 	pr_info("%s %s\n", onic_drv_str, onic_drv_ver);
-	return pci_register_driver(&pci_driver);
+
+	rv = onic_register_cpuhp();
+	if (rv < 0)
+		return rv;
+
+	rv = pci_register_driver(&pci_driver);
+	if (rv < 0)
+		onic_unregister_cpuhp();
+	return rv;
 }
 
 static void __exit onic_exit_module(void)
 {
 	pr_info("Removing ONIC driver\n");
 	pci_unregister_driver(&pci_driver);
+	onic_unregister_cpuhp();
 }
 
 module_init(onic_init_module);
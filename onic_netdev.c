@@ -19,12 +19,47 @@
 #include <linux/etherdevice.h>
 #include <linux/netdevice.h>
 #include <linux/filter.h>
+#include <linux/jump_label.h>
+#include <linux/prefetch.h>
+#include <linux/uaccess.h>
+#include <linux/bpf_trace.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <net/ip6_checksum.h>
+#include <net/tso.h>
+#include <net/pkt_sched.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#include <net/netdev_queues.h>
+#endif
 
 #include "onic_netdev.h"
+#include "onic_lib.h"
 #include "qdma_access/qdma_register.h"
 #include "onic.h"
 
+#define CREATE_TRACE_POINTS
+#include "onic_trace.h"
+
 #define ONIC_RX_DESC_STEP 256
+/* onic_tx_clean() prefetches the TX buffer entries this far ahead, enough
+ * for the fetch to land before the unmap and skb free of the entries between
+ */
+#define ONIC_TX_CLEAN_PREFETCH 4
+
+/* on while any onic device has an XDP program, see onic_rx_poll() */
+static DEFINE_STATIC_KEY_FALSE(onic_xdp_key);
 
 inline static u16 onic_ring_get_real_count(struct onic_ring *ring)
 {
@@ -38,6 +73,13 @@ inline static bool onic_ring_full(struct onic_ring *ring)
 	return ((ring->next_to_use + 1) % real_count) == ring->next_to_clean;
 }
 
+inline static u16 onic_ring_get_free(struct onic_ring *ring)
+{
+	u16 real_count = onic_ring_get_real_count(ring);
+	return (ring->next_to_clean + real_count - ring->next_to_use - 1) %
+	       real_count;
+}
+
 inline static void onic_ring_increment_head(struct onic_ring *ring)
 {
 	u16 real_count = onic_ring_get_real_count(ring);
@@ -50,44 +92,311 @@ inline static void onic_ring_increment_tail(struct onic_ring *ring)
 	ring->next_to_clean = (ring->next_to_clean + 1) % real_count;
 }
 
-static void onic_tx_clean(struct onic_tx_queue *q)
+static void onic_tx_unmap(struct onic_private *priv,
+			  struct onic_tx_buffer *buf)
+{
+	if (buf->type == ONIC_TX_NOMAP)
+		return;
+
+	if (buf->type == ONIC_SKB_FRAG)
+		dma_unmap_page(&priv->pdev->dev, buf->dma_addr, buf->len,
+			       DMA_TO_DEVICE);
+	else
+		dma_unmap_single(&priv->pdev->dev, buf->dma_addr, buf->len,
+				 DMA_TO_DEVICE);
+}
+
+/**
+ * onic_tx_clean - reclaim the descriptors the hardware has completed
+ * @q: stack TX queue
+ * @budget: NAPI budget of the TX NAPI
+ *
+ * Only called from the TX NAPI of @q, which also serializes it.
+ * skbs are freed through napi_consume_skb(), which recycles them into the
+ * per-CPU cache in NAPI context.  next_to_clean, BQL and the wakeup check
+ * are updated once for the whole batch.  skbs asking for a completion
+ * stamp get it here, when the hardware is done with them.
+ **/
+static void onic_tx_clean(struct onic_tx_queue *q, int budget)
 {
 	struct onic_private *priv = netdev_priv(q->netdev);
 	struct onic_ring *ring = &q->ring;
+	u16 real_count = onic_ring_get_real_count(ring);
 	struct qdma_wb_stat wb;
+	struct netdev_queue *txq;
+	struct onic_tx_clean_stats *stats = &priv->tx_clean_stats[q->qid];
+	unsigned int packets = 0, bytes = 0, unmaps = 0;
+	u16 ntc;
 	int work, i;
 
-	if (test_and_set_bit(0, q->state))
+	qdma_unpack_wb_stat(&wb, ring->wb);
+	ntc = ring->next_to_clean;
+
+	if (wb.cidx == ntc)
 		return;
 
-	qdma_unpack_wb_stat(&wb, ring->wb);
+	work = wb.cidx - ntc;
+	if (work < 0)
+		work += real_count;
+
+	for (i = 0; i < work; ++i) {
+		struct onic_tx_buffer *buf = &q->buffer[ntc];
+
+		if (i + ONIC_TX_CLEAN_PREFETCH < work)
+			prefetch(&q->buffer[(ntc + ONIC_TX_CLEAN_PREFETCH) %
+					    real_count]);
+		ntc = (ntc + 1) % real_count;
+
+		unmaps += buf->type != ONIC_TX_NOMAP;
+		onic_tx_unmap(priv, buf);
+		/* only set on the last descriptor of a packet */
+		if (buf->skb) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0)
+			if (unlikely(skb_shinfo(buf->skb)->tx_flags &
+				     SKBTX_COMPLETION_TSTAMP))
+				__skb_tstamp_tx(buf->skb, NULL, NULL,
+						buf->skb->sk,
+						SCM_TSTAMP_COMPLETION);
+#endif
+			napi_consume_skb(buf->skb, budget);
+		}
+		packets += buf->packets;
+		bytes += buf->bytes;
+	}
+
+	/* the entries are free for the xmit path from here on */
+	WRITE_ONCE(ring->next_to_clean, ntc);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->dma_unmaps += unmaps;
+	u64_stats_update_end(&stats->syncp);
+
+	txq = netdev_get_tx_queue(q->netdev, q->qid);
+	netdev_tx_completed_queue(txq, packets, bytes);
+
+	/* Publish next_to_clean before testing the queue state.  Pairs with
+	 * the barrier in onic_xmit_frame() between stopping the queue and
+	 * re-reading the free count, so a wakeup cannot be missed.
+	 */
+	smp_mb();
+	if (unlikely(netif_tx_queue_stopped(txq)) &&
+	    onic_ring_get_free(ring) >= ONIC_TX_WAKE_THRESH &&
+	    !test_bit(ONIC_TX_THROTTLED, q->state))
+		netif_tx_wake_queue(txq);
+}
+
+/* bytes per 8000 ns is Mbps */
+static s64 onic_tx_rate_burst(u32 mbps)
+{
+	return max_t(s64, div_u64((u64)mbps * ONIC_TX_RATE_BURST_NS, 8000),
+		     ONIC_TX_RATE_MIN_BURST);
+}
+
+static void onic_tx_rate_reset(struct onic_tx_queue *q, u32 mbps)
+{
+	q->rate_mbps = mbps;
+	q->rate_tokens = onic_tx_rate_burst(mbps);
+	q->rate_last = ktime_get_ns();
+}
+
+/**
+ * onic_tx_rate_charge - charge a transmit to the token bucket of a TX queue
+ * @q: rate limited TX queue
+ * @bytes: wire bytes just queued
+ *
+ * The packet has already been queued, so the bucket may go negative.  Return
+ * the time in nanoseconds until it refills, or 0 if the queue can go on.
+ **/
+static u64 onic_tx_rate_charge(struct onic_tx_queue *q, unsigned int bytes)
+{
+	u64 now = ktime_get_ns();
+	/* a second at any rate refills past the burst */
+	u64 elapsed = min_t(u64, now - q->rate_last, NSEC_PER_SEC);
+	s64 tokens;
+
+	tokens = q->rate_tokens + div_u64(elapsed * q->rate_mbps, 8000);
+	tokens = min(tokens, onic_tx_rate_burst(q->rate_mbps)) - bytes;
+	q->rate_tokens = tokens;
+	q->rate_last = now;
+
+	if (tokens > 0)
+		return 0;
+	return div_u64((u64)-tokens * 8000, q->rate_mbps) + 1;
+}
+
+static enum hrtimer_restart onic_tx_rate_timer(struct hrtimer *timer)
+{
+	struct onic_tx_queue *q = container_of(timer, struct onic_tx_queue,
+					       rate_timer);
+	struct netdev_queue *txq = netdev_get_tx_queue(q->netdev, q->qid);
+
+	clear_bit(ONIC_TX_THROTTLED, q->state);
+	/* pairs with the barrier in onic_tx_clean(), which otherwise wakes
+	 * the queue once the ring drains; below the threshold that wakeup is
+	 * still to come, the reclaim timer being armed while descriptors are
+	 * outstanding
+	 */
+	smp_mb__after_atomic();
+	if (onic_ring_get_free(&q->ring) >= ONIC_TX_WAKE_THRESH)
+		netif_tx_wake_queue(txq);
+
+	return HRTIMER_NORESTART;
+}
+
+static void onic_tx_arm_timer(struct onic_private *priv,
+			      struct onic_tx_queue *q)
+{
+	u32 usecs = READ_ONCE(priv->tx_coalesce_usecs[q->qid]);
+
+	if (!hrtimer_active(&q->timer))
+		hrtimer_start(&q->timer, ns_to_ktime((u64)usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart onic_tx_timer(struct hrtimer *timer)
+{
+	struct onic_tx_queue *q = container_of(timer, struct onic_tx_queue,
+					       timer);
 
-	if (wb.cidx == ring->next_to_clean) {
-		clear_bit(0, q->state);
+	napi_schedule(&q->napi);
+	return HRTIMER_NORESTART;
+}
+
+/* with the queue's db_lock held when doorbells are deferred */
+static void onic_tx_ring_db(struct onic_private *priv, struct onic_tx_queue *q,
+			    u16 pidx)
+{
+	struct onic_db_stats *stats = &priv->db_stats[q->qid];
+
+	onic_set_tx_head(priv->hw.qdma, q->qid, pidx);
+	q->db_rung = pidx;
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->doorbells++;
+	u64_stats_update_end(&stats->syncp);
+}
+
+/**
+ * onic_tx_kick - hand the packets posted so far to the hardware
+ * @priv: pointer to driver private data
+ * @q: stack or XDP TX queue, at a packet boundary
+ * @now: ring the doorbell without deferring it
+ *
+ * Called with BH disabled, by the xmit path or by the NAPI owning an XDP TX
+ * queue.  Unless tx_db_batch is set, the doorbell is rung right away.
+ * Otherwise it waits until tx_db_batch descriptors are pending or tx_db_usecs
+ * have passed, whichever comes first.
+ **/
+static void onic_tx_kick(struct onic_private *priv, struct onic_tx_queue *q,
+			 bool now)
+{
+	u16 pidx = q->ring.next_to_use;
+	int pending;
+
+	if (!priv->tx_db_batch) {
+		onic_tx_ring_db(priv, q, pidx);
 		return;
 	}
 
+	spin_lock(&q->db_lock);
+	q->db_pidx = pidx;
+	pending = pidx - q->db_rung;
+	if (pending < 0)
+		pending += onic_ring_get_real_count(&q->ring);
+	if (now || pending >= priv->tx_db_batch)
+		onic_tx_ring_db(priv, q, pidx);
+	/* A running callback is no longer queued and may already have dropped
+	 * db_lock, so re-arm.  An armed timer that finds nothing pending does
+	 * nothing.
+	 */
+	else if (!hrtimer_is_queued(&q->db_timer))
+		hrtimer_start(&q->db_timer,
+			      ns_to_ktime((u64)priv->tx_db_usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL_SOFT);
+	spin_unlock(&q->db_lock);
+}
+
+static enum hrtimer_restart onic_tx_db_timer(struct hrtimer *timer)
+{
+	struct onic_tx_queue *q = container_of(timer, struct onic_tx_queue,
+					       db_timer);
+	struct onic_private *priv = netdev_priv(q->netdev);
+
+	/* softirq context, serialized against onic_tx_kick() by db_lock */
+	spin_lock(&q->db_lock);
+	if (q->db_pidx != q->db_rung)
+		onic_tx_ring_db(priv, q, q->db_pidx);
+	spin_unlock(&q->db_lock);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * onic_tx_poll - NAPI handler reclaiming the completions of a TX queue
+ * @napi: NAPI of the TX queue
+ * @budget: NAPI budget, only tells skb freeing that it runs in NAPI context;
+ *	    TX work is not accounted against it
+ *
+ * Runs tx-usecs after a transmit, whether or not any RX traffic shows up,
+ * and keeps rescheduling itself through the timer while descriptors are
+ * outstanding.
+ **/
+static int onic_tx_poll(struct napi_struct *napi, int budget)
+{
+	struct onic_tx_queue *q = container_of(napi, struct onic_tx_queue,
+					       napi);
+	struct onic_private *priv = netdev_priv(q->netdev);
+
+	onic_tx_clean(q, budget);
+
+	if (napi_complete_done(napi, 0) &&
+	    READ_ONCE(q->ring.next_to_clean) != READ_ONCE(q->ring.next_to_use))
+		onic_tx_arm_timer(priv, q);
+
+	return 0;
+}
+
+/**
+ * onic_xdp_tx_clean - return completed frames of an XDP TX queue
+ * @q: XDP TX queue
+ *
+ * Only called from the NAPI context owning @q.  Frames live in the headroom
+ * of page pool pages that stay DMA-mapped by the pool, so there is nothing to
+ * unmap and the pages go back to their pool in bulk.
+ **/
+static void onic_xdp_tx_clean(struct onic_tx_queue *q)
+{
+	struct onic_ring *ring = &q->ring;
+	struct qdma_wb_stat wb;
+	int work, i;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	struct xdp_frame_bulk bq;
+#endif
+
+	qdma_unpack_wb_stat(&wb, ring->wb);
+
+	if (wb.cidx == ring->next_to_clean)
+		return;
+
 	work = wb.cidx - ring->next_to_clean;
 	if (work < 0)
 		work += onic_ring_get_real_count(ring);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	xdp_frame_bulk_init(&bq);
+	rcu_read_lock();	/* required by xdp_return_frame_bulk() */
 	for (i = 0; i < work; ++i) {
-		struct onic_tx_buffer *buf = &q->buffer[ring->next_to_clean];
-		dma_unmap_single(&priv->pdev->dev, buf->dma_addr, buf->len,
-				 DMA_TO_DEVICE);
-		if (buf->type == ONIC_SKB_BUFF) {
-			struct sk_buff *skb = buf->skb;
-			dev_kfree_skb_any(skb);
-		} else if (buf->type == ONIC_XDP_FRAME) {
-			struct xdp_frame *xdpf = buf->xdpf;
-			xdp_return_frame_rx_napi(xdpf);
-			kfree(xdpf);
-		}
-
+		xdp_return_frame_bulk(q->buffer[ring->next_to_clean].xdpf, &bq);
 		onic_ring_increment_tail(ring);
 	}
-
-	clear_bit(0, q->state);
+	xdp_flush_frame_bulk(&bq);
+	rcu_read_unlock();
+#else
+	for (i = 0; i < work; ++i) {
+		xdp_return_frame_rx_napi(q->buffer[ring->next_to_clean].xdpf);
+		onic_ring_increment_tail(ring);
+	}
+#endif
 }
 
 static bool onic_rx_high_watermark(struct onic_rx_queue *q)
@@ -102,6 +411,74 @@ static bool onic_rx_high_watermark(struct onic_rx_queue *q)
 	return (unused < (ONIC_RX_DESC_STEP / 2));
 }
 
+/**
+ * onic_rx_alloc_buffer - take an RX buffer from the page pool
+ * @q: RX queue
+ * @buf: RX slot to fill
+ *
+ * A buffer is a whole pool page, or in IOMMU mode a PAGE_SIZE fragment of a
+ * higher-order one.  Return 0 on success, -ENOMEM if the pool is empty.
+ **/
+static int onic_rx_alloc_buffer(struct onic_rx_queue *q,
+				struct onic_rx_buffer *buf)
+{
+	unsigned int frag = 0;
+	struct page *pg;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	if (q->pparam->order)
+		pg = page_pool_dev_alloc_frag(q->ppool, &frag, PAGE_SIZE);
+	else
+#endif
+		pg = page_pool_dev_alloc_pages(q->ppool);
+	if (!pg)
+		return -ENOMEM;
+
+	buf->pg = pg;
+	buf->offset = frag + XDP_PACKET_HEADROOM;
+	return 0;
+}
+
+/**
+ * onic_rx_replace_page - give an RX slot a fresh page from the page pool
+ * @q: RX queue
+ * @idx: descriptor index of the slot
+ *
+ * Called before the current page of the slot is handed over to an XDP frame.
+ * The slot is behind the hardware producer index, so its descriptor can be
+ * rewritten in place.  Return 0 on success, -ENOMEM if the pool is empty, in
+ * which case the slot keeps its page.
+ **/
+static int onic_rx_replace_page(struct onic_rx_queue *q, u16 idx)
+{
+	struct onic_rx_buffer *buf = &q->buffer[idx];
+	struct qdma_c2h_st_desc desc;
+
+	if (onic_rx_alloc_buffer(q, buf) < 0)
+		return -ENOMEM;
+
+	desc.dst_addr = page_pool_get_dma_addr(buf->pg) + buf->offset;
+	qdma_pack_c2h_st_desc(q->desc_ring.desc + QDMA_C2H_ST_DESC_SIZE * idx,
+			      &desc);
+	return 0;
+}
+
+/**
+ * onic_rx_reuse_page - hand the page of an RX slot back to the device
+ * @q: RX queue
+ * @buf: RX buffer keeping its page
+ **/
+static void onic_rx_reuse_page(struct onic_rx_queue *q,
+			       struct onic_rx_buffer *buf)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+
+	dma_sync_single_range_for_device(&priv->pdev->dev,
+					 page_pool_get_dma_addr(buf->pg),
+					 buf->offset, ONIC_RX_BUF_LEN,
+					 DMA_BIDIRECTIONAL);
+}
+
 static void onic_rx_refill(struct onic_rx_queue *q)
 {
 	struct onic_private *priv = netdev_priv(q->netdev);
@@ -115,22 +492,89 @@ static void onic_rx_refill(struct onic_rx_queue *q)
 
 
 static int onic_run_xdp(struct bpf_prog *xdp_prog, struct xdp_buff *xdpb) {
-	int act;
+	u32 act;
 
 	act = bpf_prog_run_xdp(xdp_prog, xdpb);
 
-	if (act == XDP_PASS)
+	switch (act) {
+	case XDP_PASS:
 		return ONIC_XDP_PASS;
-	else if (act == XDP_TX)
+	case XDP_TX:
 		return ONIC_XDP_TX;
-	else if (act == XDP_REDIRECT)
+	case XDP_REDIRECT:
 		return ONIC_XDP_REDIRECT;
-	else
+	case XDP_DROP:
 		return ONIC_XDP_DROP;
+	default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		bpf_warn_invalid_xdp_action(xdpb->rxq->dev, xdp_prog, act);
+#else
+		bpf_warn_invalid_xdp_action(act);
+#endif
+		fallthrough;
+	case XDP_ABORTED:
+		trace_xdp_exception(xdpb->rxq->dev, xdp_prog, act);
+		return ONIC_XDP_ABORTED;
+	}
+}
+
+/**
+ * onic_rx_stats_add - fold the counters of one NAPI poll into the queue stats
+ * @stats: per RX queue statistics
+ * @poll: counters accumulated on the stack during the poll
+ **/
+static void onic_rx_stats_add(struct onic_rx_stats *stats,
+			      const struct onic_rx_stats *poll)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->packets += poll->packets;
+	stats->bytes += poll->bytes;
+	stats->alloc_fail += poll->alloc_fail;
+	stats->xdp.xdp_pass += poll->xdp.xdp_pass;
+	stats->xdp.xdp_drop += poll->xdp.xdp_drop;
+	stats->xdp.xdp_tx += poll->xdp.xdp_tx;
+	stats->xdp.xdp_tx_errors += poll->xdp.xdp_tx_errors;
+	stats->xdp.xdp_redirect += poll->xdp.xdp_redirect;
+	stats->xdp.xdp_redirect_errors += poll->xdp.xdp_redirect_errors;
+	stats->xdp.xdp_aborted += poll->xdp.xdp_aborted;
+	u64_stats_update_end(&stats->syncp);
 }
 
 
-static int onic_rx_poll(struct napi_struct *napi, int budget)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+static int onic_xdp_rx_timestamp(const struct xdp_md *ctx, u64 *timestamp)
+{
+	const struct onic_xdp_buff *oxdp = (const struct onic_xdp_buff *)ctx;
+
+	if (!oxdp->rx_ts)
+		return -ENODATA;
+
+	*timestamp = oxdp->rx_ts;
+	return 0;
+}
+
+/* No xmo_rx_hash: the 8-byte C2H completion entry only carries the packet
+ * length and ID, the RSS hash computed by the shell is not written back.
+ */
+const struct xdp_metadata_ops onic_xdp_metadata_ops = {
+	.xmo_rx_timestamp = onic_xdp_rx_timestamp,
+};
+#endif
+
+/**
+ * __onic_rx_poll - RX NAPI poll loop
+ * @napi: NAPI of the RX queue
+ * @budget: NAPI budget
+ * @xdp_prog: XDP program sampled for this poll, NULL unless @xdp
+ * @xdp: run @xdp_prog on every packet
+ *
+ * Always inlined with a constant @xdp, so that the variant used while no
+ * program is attached carries no XDP code at all.
+ **/
+static __always_inline int __onic_rx_poll(struct napi_struct *napi,
+					  int budget,
+					  struct bpf_prog *xdp_prog,
+					  const bool xdp)
 {
 	struct onic_rx_queue *q =
 		container_of(napi, struct onic_rx_queue, napi);
@@ -142,16 +586,23 @@ static int onic_rx_poll(struct napi_struct *napi, int budget)
 	struct qdma_c2h_cmpl_stat cmpl_stat;
 	u8 *cmpl_ptr;
 	u8 *cmpl_stat_ptr;
-	u32 color_stat;
 	int work = 0;
-	int i, rv;
+	int rv;
 	bool napi_cmpl_rval = 0;
 	bool flipped = 0;
-	bool debug = 0;
-	struct xdp_buff xdpb;
-
-	for (i = 0; i < priv->num_tx_queues; i++)
-		onic_tx_clean(priv->tx_queue[i]);
+	bool xdp_tx = false;
+	bool xdp_redirect = false;
+	struct onic_rx_stats poll_stats = {};
+	struct onic_xdp_buff oxdp;
+	struct xdp_buff *xdpb = &oxdp.xdp;
+
+	/* one stamp for the completion burst, for XDP and the stack alike */
+	oxdp.rx_ts = ktime_get_real_ns();
+
+	if (xdp) {
+		xdp_init_buff(xdpb, PAGE_SIZE, &q->xdp_rxq);
+		onic_xdp_tx_clean(priv->xdp_tx_queue[qid]);
+	}
 
 	cmpl_ptr =
 		cmpl_ring->desc + QDMA_C2H_CMPL_SIZE * cmpl_ring->next_to_clean;
@@ -161,20 +612,9 @@ static int onic_rx_poll(struct napi_struct *napi, int budget)
 	qdma_unpack_c2h_cmpl(&cmpl, cmpl_ptr);
 	qdma_unpack_c2h_cmpl_stat(&cmpl_stat, cmpl_stat_ptr);
 
-	color_stat = cmpl_stat.color;
-	if (debug)
-		netdev_info(
-			q->netdev,
-			"\n rx_poll:  cmpl_stat_pidx %u, color_cmpl_stat %u, cmpl_ring next_to_clean %u, cmpl_stat_cidx %u, intr_state %u, cmpl_ring->count %u",
-			cmpl_stat.pidx, color_stat, cmpl_ring->next_to_clean,
-			cmpl_stat.cidx, cmpl_stat.intr_state, cmpl_ring->count);
-
-	if (debug)
-		netdev_info(
-			q->netdev,
-			"c2h_cmpl pkt_id %u, pkt_len %u, error %u, color %u cmpl_ring->color:%u",
-			cmpl.pkt_id, cmpl.pkt_len, cmpl.err, cmpl.color,
-			cmpl_ring->color);
+	trace_onic_rx_poll(q->netdev, qid, &cmpl_stat,
+			   cmpl_ring->next_to_clean, cmpl_ring->color);
+	trace_onic_rx_cmpl(q->netdev, qid, &cmpl, cmpl_ring->color);
 
 	/* Color of completion entries and completion ring are initialized to 0
 	 * and 1 respectively.  When an entry is filled, it has a color bit of
@@ -184,18 +624,7 @@ static int onic_rx_poll(struct napi_struct *napi, int budget)
 	 * hardware.  Therefore, it becomes that completion entries are filled
 	 * with a color 0, and completion ring has a color 0 as well.
 	 */
-	if (cmpl.color != cmpl_ring->color) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"color mismatch1: cmpl.color %u, cmpl_ring->color %u  cmpl_stat_color %u",
-				cmpl.color, cmpl_ring->color, color_stat);
-	}
-
 	if (cmpl.err == 1) {
-		if (debug)
-			netdev_info(q->netdev,
-				    "completion error detected in cmpl entry!");
 		// todo: need to handle the error ...
 		onic_qdma_clear_error_interrupt(priv->hw.qdma);
 	}
@@ -205,195 +634,219 @@ static int onic_rx_poll(struct napi_struct *napi, int budget)
 		struct onic_rx_buffer *buf =
 			&q->buffer[desc_ring->next_to_clean];
 		struct sk_buff *skb;
-		u8 *data;
 		u8 *page;
 		int len = cmpl.pkt_len;
 		int xdp_ret = ONIC_XDP_PASS;
 		/* maximum packet size is 1514, less than the page size */
 
-		page = (u8 *)page_address(buf->pg);
-		data = (u8 *)(page + buf->offset);
-
-		xdpb.data_hard_start = page;
-		xdpb.data = page + buf->offset;
-		xdpb.data_end = xdpb.data + len;
-		xdpb.frame_sz = PAGE_SIZE;
-		xdpb.rxq = &q->xdp_rxq;
-		if (priv->prog)
-			xdp_ret = onic_run_xdp(priv->prog, &xdpb);
+		/* start of the PAGE_SIZE buffer, headroom included */
+		page = (u8 *)page_address(buf->pg) + buf->offset -
+		       XDP_PACKET_HEADROOM;
+		dma_sync_single_range_for_cpu(&priv->pdev->dev,
+					      page_pool_get_dma_addr(buf->pg),
+					      buf->offset, len,
+					      DMA_BIDIRECTIONAL);
+
+		if (xdp) {
+			xdp_prepare_buff(xdpb, page, XDP_PACKET_HEADROOM, len,
+					 true);
+			oxdp.cmpl = &cmpl;
+			xdp_ret = onic_run_xdp(xdp_prog, xdpb);
+		}
 		if ( xdp_ret == ONIC_XDP_PASS ) {
+			/* the program may have moved data and prepended metadata */
+			const u8 *data = xdp ? xdpb->data_meta :
+					 page + XDP_PACKET_HEADROOM;
+			unsigned int metasize = xdp ? xdpb->data - xdpb->data_meta : 0;
+			unsigned int pkt_len = xdp ? xdpb->data_end - xdpb->data : len;
 
-			if (priv->prog)
-				priv->xdp_stats.xdp_passed++;
-			skb = napi_alloc_skb(napi, len);
+			skb = napi_alloc_skb(napi, metasize + pkt_len);
 			if (!skb) {
+				poll_stats.alloc_fail++;
 				rv = -ENOMEM;
 				break;
 			}
+			if (xdp)
+				poll_stats.xdp.xdp_pass++;
 
-			skb_put_data(skb, data, len);
+			skb_put_data(skb, data, metasize + pkt_len);
+			if (metasize) {
+				__skb_pull(skb, metasize);
+				skb_metadata_set(skb, metasize);
+			}
 			skb->protocol = eth_type_trans(skb, q->netdev);
 			skb->ip_summed = CHECKSUM_NONE;
 			/*
 
-			skb = build_skb(xdpb.data, PAGE_SIZE);		// Needs space at tail for struct skb_shared_info, handled through pparams->max_len
+			skb = build_skb(xdpb->data, PAGE_SIZE);		// Needs space at tail for struct skb_shared_info, handled through pparams->max_len
 			page_pool_release_page(q->ppool, (struct page *)page);	// Disconnect page from page pool, to allow for regular page usage
 			*/
 			skb_record_rx_queue(skb, qid);
-			page_pool_put_page(q->ppool, (struct page *)page, PAGE_SIZE, 0);	// Return page to page pool
+			skb->tstamp = ns_to_ktime(oxdp.rx_ts);
+			/* the data was copied, the page stays in its slot */
+			onic_rx_reuse_page(q, buf);
 
 			rv = napi_gro_receive(napi, skb);
 			if (rv < 0) {
 				netdev_err(q->netdev, "napi_gro_receive, err = %d", rv);
 				break;
 			}
-		} else if (xdp_ret == ONIC_XDP_DROP) {
-			priv->xdp_stats.xdp_dropped++;
-			netdev_info(q->netdev, "xdp_dropped: %llu\n", priv->xdp_stats.xdp_dropped);
-			page_pool_put_page(q->ppool, (struct page *)page, PAGE_SIZE, 0);	// Return page to page pool
+		} else if (xdp_ret == ONIC_XDP_DROP || xdp_ret == ONIC_XDP_ABORTED) {
+			if (xdp_ret == ONIC_XDP_DROP)
+				poll_stats.xdp.xdp_drop++;
+			else
+				poll_stats.xdp.xdp_aborted++;
+			onic_rx_reuse_page(q, buf);
+		} else if (xdp_ret == ONIC_XDP_REDIRECT) {
+			struct page *pg = buf->pg;
+
+			/* the page leaves the slot for good once redirected */
+			if (onic_rx_replace_page(q, desc_ring->next_to_clean) < 0) {
+				poll_stats.alloc_fail++;
+				poll_stats.xdp.xdp_redirect_errors++;
+				onic_rx_reuse_page(q, buf);
+			} else if (xdp_do_redirect(q->netdev, xdpb, xdp_prog) < 0) {
+				poll_stats.xdp.xdp_redirect_errors++;
+				page_pool_recycle_direct(q->ppool, pg);
+			} else {
+				poll_stats.xdp.xdp_redirect++;
+				xdp_redirect = true;
+			}
 		} else if (xdp_ret == ONIC_XDP_TX) {
-			int ret;
-			struct xdp_frame *xdpf;
-			xdpf = kzalloc(sizeof(*xdpf), GFP_ATOMIC);
+			/* the frame is built in the headroom of the RX page */
+			struct xdp_frame *xdpf = xdp_convert_buff_to_frame(xdpb);
+
 			if (!xdpf) {
-				priv->xdp_stats.xdp_tx_dropped++;
-				page_pool_put_page(q->ppool, (struct page *)page, PAGE_SIZE, 0);	// Return page to page pool
+				poll_stats.xdp.xdp_tx_errors++;
+				onic_rx_reuse_page(q, buf);
+			} else if (onic_rx_replace_page(q, desc_ring->next_to_clean) < 0) {
+				poll_stats.alloc_fail++;
+				poll_stats.xdp.xdp_tx_errors++;
+				onic_rx_reuse_page(q, buf);
+			} else if (onic_xmit_xdp_frame(xdpf, q->netdev, qid) < 0) {
+				/* the frame, and its page, went back to the pool */
+				poll_stats.xdp.xdp_tx_errors++;
 			} else {
-				ret  = xdp_update_frame_from_buff(&xdpb, xdpf);
-				if (ret < 0) {
-					priv->xdp_stats.xdp_tx_dropped++;
-					page_pool_put_page(q->ppool, (struct page *)page, PAGE_SIZE, 0);	// Return page to page pool
-					kfree(xdpf);
-				} else {
-					onic_xmit_xdp_frame(xdpf, q->netdev, qid);
-				}
+				poll_stats.xdp.xdp_tx++;
+				xdp_tx = true;
 			}
 		}
-		priv->netdev_stats.rx_packets++;
-		priv->netdev_stats.rx_bytes += len;
+		poll_stats.packets++;
+		poll_stats.bytes += len;
 
 		onic_ring_increment_tail(desc_ring);
 
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"desc_ring %u next_to_use:%u next_to_clean:%u",
-				onic_ring_get_real_count(desc_ring),
-				desc_ring->next_to_use,
-				desc_ring->next_to_clean);
-		if (onic_ring_full(desc_ring)) {
-			netdev_dbg(q->netdev, "desc_ring full");
-		}
-
-		if (onic_rx_high_watermark(q)) {
-			netdev_dbg(q->netdev, "High watermark: h = %d, t = %d",
-				   desc_ring->next_to_use,
-				   desc_ring->next_to_clean);
+		if (onic_rx_high_watermark(q))
 			onic_rx_refill(q);
-		}
 
 		onic_ring_increment_tail(cmpl_ring);
 
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"cmpl_ring %u next_to_use:%u next_to_clean:%u, flipped:%s",
-				onic_ring_get_real_count(cmpl_ring),
-				cmpl_ring->next_to_use,
-				cmpl_ring->next_to_clean,
-				flipped ? "true" : "false");
-		if (onic_ring_full(cmpl_ring)) {
-			netdev_dbg(q->netdev, "cmpl_ring full");
-		}
 		if (cmpl.color != cmpl_ring->color) {
-			if (debug)
-				netdev_info(
-					q->netdev,
-					"part 1. cmpl_ring->next_to_clean=%u color *** old fliping *** color[%u]",
-					cmpl_ring->next_to_clean,
-					cmpl_ring->color);
 			cmpl_ring->color = (cmpl_ring->color == 0) ? 1 : 0;
 			flipped = 1;
 		}
+		trace_onic_rx_ring(q->netdev, qid, desc_ring->next_to_use,
+				   desc_ring->next_to_clean,
+				   cmpl_ring->next_to_clean, flipped);
 		cmpl_ptr = cmpl_ring->desc +
 			   (QDMA_C2H_CMPL_SIZE * cmpl_ring->next_to_clean);
 
 		if ((++work) >= budget) {
-			if (debug)
-				netdev_info(q->netdev,
-					    "watchdog work %u, budget %u", work,
-					    budget);
 			napi_complete(napi);
 			napi_reschedule(napi);
 			goto out_of_budget;
 		}
 
 		qdma_unpack_c2h_cmpl(&cmpl, cmpl_ptr);
-
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"c2h_cmpl(b) pkt_id %u, pkt_len %u, error %u, color %u",
-				cmpl.pkt_id, cmpl.pkt_len, cmpl.err,
-				cmpl.color);
+		trace_onic_rx_cmpl(q->netdev, qid, &cmpl, cmpl_ring->color);
 	}
 
 	if (cmpl_ring->next_to_clean == cmpl_stat.pidx) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"next_to_clean == cmpl_stat.pidx %u, napi_complete work %u, budget %u, rval %s",
-				cmpl_stat.pidx, work, budget,
-				napi_cmpl_rval ? "true" : "false");
 		napi_cmpl_rval = napi_complete_done(napi, work);
 		onic_set_completion_tail(priv->hw.qdma, qid,
 					 cmpl_ring->next_to_clean, 1);
-		if (debug)
-			netdev_info(q->netdev, "onic_set_completion_tail ");
 	} else if (cmpl_ring->next_to_clean == 0) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"next_to_clean == 0, napi_complete work %u, budget %u, rval %s",
-				work, budget,
-				napi_cmpl_rval ? "true" : "false");
-		if (debug)
-			netdev_info(q->netdev,
-				    "napi_complete work %u, budget %u, rval %s",
-				    work, budget,
-				    napi_cmpl_rval ? "true" : "false");
 		napi_cmpl_rval = napi_complete_done(napi, work);
 		onic_set_completion_tail(priv->hw.qdma, qid,
 					 cmpl_ring->next_to_clean, 1);
-		if (debug)
-			netdev_info(q->netdev, "onic_set_completion_tail ");
 	}
 
 out_of_budget:
-	if (debug)
-		netdev_info(q->netdev, "rx_poll is done");
-	if (debug)
-		netdev_info(
-			q->netdev,
-			"rx_poll returning work %u, rx_packets %lld, rx_bytes %lld",
-			work, priv->netdev_stats.rx_packets,
-			priv->netdev_stats.rx_bytes);
+	if (xdp) {
+		/* one doorbell for all the XDP_TX frames of this poll */
+		if (xdp_tx)
+			onic_xdp_tx_flush(q->netdev, qid);
+		if (xdp_redirect)
+			xdp_do_flush();
+	}
+	onic_rx_stats_add(&priv->rx_stats[qid], &poll_stats);
+	trace_onic_rx_poll_done(q->netdev, qid, work, budget,
+				poll_stats.packets, poll_stats.bytes,
+				napi_cmpl_rval);
 	return work;
 }
 
-static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
+static int onic_rx_poll_skb(struct napi_struct *napi, int budget)
 {
-	struct onic_tx_queue *q = priv->tx_queue[qid];
-	struct onic_ring *ring;
+	return __onic_rx_poll(napi, budget, NULL, false);
+}
+
+static int onic_rx_poll_xdp(struct napi_struct *napi, int budget,
+			    struct bpf_prog *xdp_prog)
+{
+	return __onic_rx_poll(napi, budget, xdp_prog, true);
+}
+
+static int onic_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct onic_rx_queue *q =
+		container_of(napi, struct onic_rx_queue, napi);
+	struct onic_private *priv = netdev_priv(q->netdev);
+
+	/* The key is on while any onic device has a program, and is raised
+	 * before the program is published.  NAPI runs inside an RCU read-side
+	 * section, so the program sampled here stays valid for the whole poll
+	 * even if it is replaced meanwhile.
+	 */
+	if (static_branch_unlikely(&onic_xdp_key)) {
+		struct bpf_prog *xdp_prog = READ_ONCE(priv->prog);
+
+		if (xdp_prog)
+			return onic_rx_poll_xdp(napi, budget, xdp_prog);
+	}
+
+	return onic_rx_poll_skb(napi, budget);
+}
+
+/**
+ * onic_free_tx_queue - disable a QDMA H2C queue and free its resources
+ * @priv: pointer to driver private data
+ * @q: TX queue, either a stack queue or an XDP TX queue
+ **/
+static void onic_free_tx_queue(struct onic_private *priv,
+			       struct onic_tx_queue *q)
+{
+	struct onic_ring *ring = &q->ring;
 	u32 size;
 	int real_count;
 
-	if (!q)
-		return;
+	hrtimer_cancel(&q->db_timer);
+	onic_qdma_clear_tx_queue(priv->hw.qdma, q->qid);
 
-	onic_qdma_clear_tx_queue(priv->hw.qdma, qid);
+	/* the queue is stopped, release what the hardware did not complete */
+	while (q->buffer && ring->next_to_clean != ring->next_to_use) {
+		struct onic_tx_buffer *buf = &q->buffer[ring->next_to_clean];
+
+		if (buf->type == ONIC_XDP_FRAME) {
+			xdp_return_frame(buf->xdpf);
+		} else {
+			onic_tx_unmap(priv, buf);
+			if (buf->skb)
+				dev_kfree_skb_any(buf->skb);
+		}
+		onic_ring_increment_tail(ring);
+	}
 
-	ring = &q->ring;
 	real_count = onic_ring_get_real_count(ring);
 	size = QDMA_H2C_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
 	size = ALIGN(size, PAGE_SIZE);
@@ -401,40 +854,52 @@ static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
 	if (ring->desc)
 		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
 				  ring->dma_addr);
+	if (q->slots)
+		dma_free_coherent(&priv->pdev->dev,
+				  ALIGN(priv->tx_slot_size * real_count, PAGE_SIZE),
+				  q->slots, q->slots_dma);
 	kfree(q->buffer);
 	kfree(q);
-	priv->tx_queue[qid] = NULL;
 }
 
-static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
+/**
+ * onic_alloc_tx_queue - allocate a TX ring and initialize its QDMA H2C queue
+ * @priv: pointer to driver private data
+ * @qid: QDMA queue ID, relative to the function queue base
+ * @vid: vector ID the queue is associated with
+ * @qp: returns the allocated queue on success
+ *
+ * Return 0 on success, negative on failure
+ **/
+static int onic_alloc_tx_queue(struct onic_private *priv, u16 qid, u16 vid,
+			       struct onic_tx_queue **qp)
 {
 	const u8 rngcnt_idx = 0;
-	struct net_device *dev = priv->netdev;
+	/* near the CPU the vector interrupts, hence the reclaim runs on */
+	int node = priv->q_vector[vid]->numa_node;
 	struct onic_tx_queue *q;
 	struct onic_ring *ring;
 	struct onic_qdma_h2c_param param;
-	u16 vid;
 	u32 size, real_count;
 	int rv;
-	bool debug = 0;
 
-	if (priv->tx_queue[qid]) {
-		if (debug)
-			netdev_info(dev, "Re-initializing TX queue %d", qid);
-		onic_clear_tx_queue(priv, qid);
-	}
-
-	q = kzalloc(sizeof(struct onic_tx_queue), GFP_KERNEL);
+	q = kzalloc_node(sizeof(struct onic_tx_queue), GFP_KERNEL, node);
 	if (!q)
 		return -ENOMEM;
 
-	/* evenly assign to TX queues available vectors */
-	vid = qid % priv->num_q_vectors;
-
-	q->netdev = dev;
+	q->netdev = priv->netdev;
 	q->vector = priv->q_vector[vid];
 	q->qid = qid;
 
+	spin_lock_init(&q->db_lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&q->db_timer, onic_tx_db_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+#else
+	hrtimer_init(&q->db_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	q->db_timer.function = onic_tx_db_timer;
+#endif
+
 	ring = &q->ring;
 	ring->count = onic_ring_count(rngcnt_idx);
 	real_count = onic_ring_get_real_count(ring);
@@ -446,7 +911,7 @@ static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
 					GFP_KERNEL);
 	if (!ring->desc) {
 		rv = -ENOMEM;
-		goto clear_tx_queue;
+		goto free_tx_queue;
 	}
 	memset(ring->desc, 0, size);
 	ring->wb = ring->desc + QDMA_H2C_ST_DESC_SIZE * real_count;
@@ -456,10 +921,11 @@ static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
 
 	/* initialize TX buffers */
 	q->buffer =
-		kcalloc(real_count, sizeof(struct onic_tx_buffer), GFP_KERNEL);
+		kcalloc_node(real_count, sizeof(struct onic_tx_buffer),
+			     GFP_KERNEL, node);
 	if (!q->buffer) {
 		rv = -ENOMEM;
-		goto clear_tx_queue;
+		goto free_tx_queue;
 	}
 
 	/* initialize QDMA H2C queue */
@@ -468,92 +934,321 @@ static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
 	param.vid = vid;
 	rv = onic_qdma_init_tx_queue(priv->hw.qdma, qid, &param);
 	if (rv < 0)
-		goto clear_tx_queue;
+		goto free_tx_queue;
 
-	priv->tx_queue[qid] = q;
+	*qp = q;
 	return 0;
 
-clear_tx_queue:
-	onic_clear_tx_queue(priv, qid);
+free_tx_queue:
+	onic_free_tx_queue(priv, q);
 	return rv;
 }
 
-static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
+static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
 {
-	struct onic_rx_queue *q = priv->rx_queue[qid];
-	struct onic_ring *ring;
-	struct net_device *dev = priv->netdev;
-	u32 size, real_count;
-	int i;
+	struct onic_tx_queue *q = priv->tx_queue[qid];
 
 	if (!q)
 		return;
 
-	onic_qdma_clear_rx_queue(priv->hw.qdma, qid);
-
+	/* a timer firing after napi_disable() cannot schedule it anymore */
 	napi_disable(&q->napi);
+	hrtimer_cancel(&q->timer);
+	hrtimer_cancel(&q->rate_timer);
 	netif_napi_del(&q->napi);
 
-	ring = &q->desc_ring;
-	real_count = onic_ring_get_real_count(ring);
-	size = QDMA_C2H_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
-	size = ALIGN(size, PAGE_SIZE);
+	onic_free_tx_queue(priv, q);
+	priv->tx_queue[qid] = NULL;
+}
 
-	if (ring->desc)
+static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
+{
+	struct net_device *dev = priv->netdev;
+	struct onic_tx_queue *q;
+	u32 size;
+	u16 vid;
+	int rv;
+	bool debug = 0;
+
+	if (priv->tx_queue[qid]) {
+		if (debug)
+			netdev_info(dev, "Re-initializing TX queue %d", qid);
+		onic_clear_tx_queue(priv, qid);
+	}
+
+	/* evenly assign to TX queues available vectors */
+	vid = qid % priv->num_q_vectors;
+
+	rv = onic_alloc_tx_queue(priv, qid, vid, &q);
+	if (rv < 0)
+		return rv;
+
+	netdev_tx_reset_queue(netdev_get_tx_queue(dev, qid));
+
+	/* the slot of a descriptor is reused as soon as the descriptor is */
+	size = ALIGN(priv->tx_slot_size * onic_ring_get_real_count(&q->ring),
+		     PAGE_SIZE);
+	q->slots = dma_alloc_coherent(&priv->pdev->dev, size, &q->slots_dma,
+				      GFP_KERNEL);
+	if (!q->slots) {
+		onic_free_tx_queue(priv, q);
+		return -ENOMEM;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&q->timer, onic_tx_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+	hrtimer_setup(&q->rate_timer, onic_tx_rate_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&q->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->timer.function = onic_tx_timer;
+	hrtimer_init(&q->rate_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->rate_timer.function = onic_tx_rate_timer;
+#endif
+	onic_tx_rate_reset(q, priv->tx_maxrate[qid]);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	netif_napi_add_tx(dev, &q->napi, onic_tx_poll);
+#else
+	netif_tx_napi_add(dev, &q->napi, onic_tx_poll, NAPI_POLL_WEIGHT);
+#endif
+	napi_enable(&q->napi);
+
+	priv->tx_queue[qid] = q;
+	return 0;
+}
+
+static void onic_clear_xdp_tx_queue(struct onic_private *priv, u16 qid)
+{
+	struct onic_tx_queue *q = priv->xdp_tx_queue[qid];
+
+	if (!q)
+		return;
+
+	onic_free_tx_queue(priv, q);
+	priv->xdp_tx_queue[qid] = NULL;
+}
+
+/**
+ * onic_init_xdp_tx_queue - initialize the XDP TX queue of an RX queue
+ * @priv: pointer to driver private data
+ * @qid: RX queue ID owning the XDP TX queue
+ *
+ * XDP TX queues are extra QDMA H2C queues placed after the stack TX queues.
+ * Each one is only ever used from the NAPI context of RX queue @qid, which
+ * makes it single-producer and lets XDP_TX run without any lock.  Return 0 on
+ * success, negative on failure.
+ **/
+static int onic_init_xdp_tx_queue(struct onic_private *priv, u16 qid)
+{
+	struct onic_tx_queue *q;
+	u16 vid;
+	int rv;
+
+	if (priv->xdp_tx_queue[qid])
+		onic_clear_xdp_tx_queue(priv, qid);
+
+	/* share the vector with the owning RX queue */
+	vid = qid % priv->num_q_vectors;
+
+	rv = onic_alloc_tx_queue(priv, priv->num_tx_queues + qid, vid, &q);
+	if (rv < 0)
+		return rv;
+
+	priv->xdp_tx_queue[qid] = q;
+	return 0;
+}
+
+static void onic_clear_xdp_tx_resource(struct onic_private *priv)
+{
+	int qid;
+
+	for (qid = 0; qid < priv->num_rx_queues; ++qid)
+		onic_clear_xdp_tx_queue(priv, qid);
+}
+
+static int onic_init_xdp_tx_resource(struct onic_private *priv)
+{
+	struct net_device *dev = priv->netdev;
+	int qid, rv;
+
+	for (qid = 0; qid < priv->num_rx_queues; ++qid) {
+		rv = onic_init_xdp_tx_queue(priv, qid);
+		if (!rv)
+			continue;
+
+		netdev_err(dev, "onic_init_xdp_tx_queue %d, err = %d", qid, rv);
+		goto clear_xdp_tx_resource;
+	}
+
+	return 0;
+
+clear_xdp_tx_resource:
+	while (qid--)
+		onic_clear_xdp_tx_queue(priv, qid);
+	return rv;
+}
+
+/**
+ * onic_free_rx_queue - free the resources of a possibly half-built RX queue
+ * @priv: pointer to driver private data
+ * @q: RX queue, with its QDMA queue and NAPI already torn down
+ **/
+static void onic_free_rx_queue(struct onic_private *priv,
+			       struct onic_rx_queue *q)
+{
+	struct onic_ring *ring;
+	u32 size, real_count;
+	int i;
+
+	ring = &q->cmpl_ring;
+	if (ring->desc) {
+		real_count = onic_ring_get_real_count(ring);
+		size = QDMA_C2H_CMPL_SIZE * real_count + QDMA_C2H_CMPL_STAT_SIZE;
+		size = ALIGN(size, PAGE_SIZE);
 		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
 				  ring->dma_addr);
+	}
+
+	ring = &q->desc_ring;
+	if (!ring->desc)
+		goto free_pool;
 
-	ring = &q->cmpl_ring;
 	real_count = onic_ring_get_real_count(ring);
-	size = QDMA_C2H_CMPL_SIZE * real_count + QDMA_C2H_CMPL_STAT_SIZE;
+	size = QDMA_C2H_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
 	size = ALIGN(size, PAGE_SIZE);
+	dma_free_coherent(&priv->pdev->dev, size, ring->desc, ring->dma_addr);
 
-	if (ring->desc)
-		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
-				  ring->dma_addr);
+	if (q->buffer) {
+		for (i = 0; i < real_count; ++i) {
+			struct page *pg = q->buffer[i].pg;
+
+			if (pg)
+				page_pool_put_full_page(q->ppool, pg, false);
+		}
+		kfree(q->buffer);
+	}
+
+free_pool:
+	/* also drops the memory model reference on the page pool */
+	if (xdp_rxq_info_is_reg(&q->xdp_rxq))
+		xdp_rxq_info_unreg(&q->xdp_rxq);
+	/* pages still held by in-flight XDP frames keep the pool alive until
+	 * they are returned
+	 */
+	if (q->ppool) {
+#ifdef CONFIG_PAGE_POOL_STATS
+		struct page_pool_stats pps = {};
+
+		/* keeps rx<N>_dma_maps monotonic across ifdown */
+		if (page_pool_get_stats(q->ppool, &pps))
+			priv->rx_dma_maps[q->qid] +=
+				pps.alloc_stats.slow_high_order;
+#endif
+		page_pool_destroy(q->ppool);
+	}
+	kfree(q->pparam);
+	kfree(q);
+}
+
+static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
+{
+	struct onic_rx_queue *q = priv->rx_queue[qid];
+
+	if (!q)
+		return;
+
+	onic_qdma_clear_rx_queue(priv->hw.qdma, qid);
+
+	napi_disable(&q->napi);
+	netif_napi_del(&q->napi);
 
-	for (i = 0; i < real_count; ++i) {
-		struct page *pg = q->buffer[i].pg;
-		page_pool_recycle_direct(q->ppool, pg);
-	}
-	netdev_info(dev, "Freed memory for %d pages ", real_count);
+	onic_free_rx_queue(priv, q);
+	priv->rx_queue[qid] = NULL;
+}
 
-	kfree(q->buffer);
+/**
+ * onic_xdp_quiesce - stop or restart NAPI on every RX queue
+ * @priv: pointer to driver private data
+ * @stop: true to disable NAPI, false to enable it again
+ *
+ * Used around XDP attach and detach so that no poller observes a half-updated
+ * XDP state.  Rings, pages and DMA mappings are left untouched.
+ **/
+static void onic_xdp_quiesce(struct onic_private *priv, bool stop)
+{
+	int qid;
 
-	xdp_rxq_info_unreg_mem_model(&q->xdp_rxq);
-	if(xdp_rxq_info_is_reg(&q->xdp_rxq))
-		xdp_rxq_info_unreg(&q->xdp_rxq);
+	for (qid = 0; qid < priv->num_rx_queues; ++qid) {
+		struct onic_rx_queue *q = priv->rx_queue[qid];
 
+		if (!q)
+			continue;
 
-	if (q->pparam)
-		kfree(q->pparam);
-	kfree(q);
-	priv->rx_queue[qid] = NULL;
+		if (stop) {
+			napi_disable(&q->napi);
+		} else {
+			napi_enable(&q->napi);
+			/* an interrupt dropped while NAPI was disabled left the
+			 * completion ring unarmed, so poll once to rearm it
+			 */
+			napi_schedule(&q->napi);
+		}
+	}
 }
 
 static int onic_xdp_setup(struct net_device *dev, struct bpf_prog *prog, struct netlink_ext_ack *extack)
 //extack is a mechanism to communicate with the user space via netlink
 {
-	int running, need_update;
 	struct onic_private *priv = netdev_priv(dev);
 	struct bpf_prog *old_prog;
+	bool running, need_update;
+	int rv;
 
 	if (prog && (dev->mtu > ONIC_MAX_QDMA_BUF_SIZE)) {
 		NL_SET_ERR_MSG_MOD(extack, "Program does not support XDP fragments\n"); //*_MOD() includes module name in error message
 		return -EOPNOTSUPP;
 	}
 
+	/* Replacing a program is a plain pointer swap: pollers pick up the new
+	 * program on their next run, and bpf_prog_put() defers freeing the old
+	 * one past an RCU grace period.  Attach and detach additionally quiesce
+	 * NAPI so that the XDP on/off transition is seen atomically per queue.
+	 */
 	need_update = !!priv->prog != !!prog;
-	if (need_update) {
-		running = netif_running(dev);
-		if (running)
-			onic_stop_netdev(dev);
-		old_prog = xchg(&priv->prog, prog);
-		if (old_prog)
-			bpf_prog_put(old_prog);	//Needs to be bpf_prog_put since driver owns old_prog 
-		if (running)
-			onic_open_netdev(dev);
+	running = netif_running(dev);
+
+	if (need_update && running && prog) {
+		rv = onic_init_xdp_tx_resource(priv);
+		if (rv < 0) {
+			NL_SET_ERR_MSG_MOD(extack, "Failed to allocate XDP TX queues");
+			return rv;
+		}
 	}
+
+	/* the key goes up before the program shows and down after it is gone,
+	 * pollers see no program rather than skip one
+	 */
+	if (need_update && prog)
+		static_branch_inc(&onic_xdp_key);
+
+	if (need_update && running)
+		onic_xdp_quiesce(priv, true);
+
+	old_prog = xchg(&priv->prog, prog);
+
+	if (need_update && running)
+		onic_xdp_quiesce(priv, false);
+
+	if (need_update && !prog)
+		static_branch_dec(&onic_xdp_key);
+
+	/* pollers restarted without a program never touch XDP TX queues */
+	if (need_update && running && !prog)
+		onic_clear_xdp_tx_resource(priv);
+
+	if (old_prog)
+		bpf_prog_put(old_prog);	//Needs to be bpf_prog_put since driver owns old_prog
 	return 0;
 }
 
@@ -567,18 +1262,29 @@ int onic_xdp(struct net_device *dev, struct netdev_bpf *bpf)
 	}
 }
 
-static void init_pparam(struct page_pool_params *pparams, struct onic_private *priv, const u8 desc_rngcnt_idx)
+static void init_pparam(struct page_pool_params *pparams, struct onic_private *priv, const u8 desc_rngcnt_idx, int node)
 {
-	pparams->order = 0;		// If order > 0, then multiple block of pages are requested per packet
-					// e.g. Jumbo packets can ask for order 2 = 4 pages for 9000B packets
-	//pparams->flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
-	pparams->flags = 0;	// If I ask the page pool API to do DMA mapping, it fails to allocate memory. Why?
+	pparams->order = priv->rx_page_order;	// > 0: pool pages are carved into PAGE_SIZE buffers
+	/* Pages stay mapped for their whole life in the pool.  Bidirectional,
+	 * since XDP_TX sends a page straight from the RX buffer.
+	 */
+	pparams->flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
 	pparams->pool_size = onic_ring_count(desc_rngcnt_idx);
-	pparams->nid = 0;
-	pparams->dev = &priv->netdev->dev;
-	pparams->offset = XDP_PACKET_HEADROOM;
+	pparams->nid = node;		// pages local to the NAPI CPU
+	pparams->dev = &priv->pdev->dev;	// DMA goes through the PCI device
 	pparams->dma_dir = DMA_BIDIRECTIONAL;
-	pparams->max_len = PAGE_SIZE - (SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) + pparams->offset);	//To align with build_skb() call
+	if (!pparams->order) {
+		pparams->offset = XDP_PACKET_HEADROOM;
+		pparams->max_len = ONIC_RX_BUF_LEN;	//To align with build_skb() call
+		return;
+	}
+
+	/* a recycled pool page is synced whole, before it is carved again */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 6, 0)
+	pparams->flags |= PP_FLAG_PAGE_FRAG;
+#endif
+	pparams->offset = 0;
+	pparams->max_len = PAGE_SIZE << pparams->order;
 }
 
 static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
@@ -595,8 +1301,8 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 	struct page_pool *ppool;
 	u16 vid;
 	u32 size, real_count;
+	int node;
 	int i, rv;
-	int err;
 	bool debug = 0;
 
 	if (priv->rx_queue[qid]) {
@@ -605,40 +1311,46 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 		onic_clear_rx_queue(priv, qid);
 	}
 
-	q = kzalloc(sizeof(struct onic_rx_queue), GFP_KERNEL);
+	/* evenly assign to RX queues available vectors */
+	vid = qid % priv->num_q_vectors;
+	node = priv->q_vector[vid]->numa_node;
+
+	q = kzalloc_node(sizeof(struct onic_rx_queue), GFP_KERNEL, node);
 	if (!q)
 		return -ENOMEM;
 
 	netdev_info(dev, "Allocated memory for onic_rx_queue ");
-	/* evenly assign to RX queues available vectors */
-	vid = qid % priv->num_q_vectors;
 
 	q->netdev = dev;
 	q->vector = priv->q_vector[vid];
 	q->qid = qid;
 
 	/* Setup per queue page pool */
-	pparam = kzalloc(sizeof(struct page_pool_params), GFP_KERNEL);
-	if (!pparam)
-		goto clear_rx_queue;
+	pparam = kzalloc_node(sizeof(struct page_pool_params), GFP_KERNEL, node);
+	if (!pparam) {
+		rv = -ENOMEM;
+		goto free_rx_queue;
+	}
+	q->pparam = pparam;
 
-	init_pparam(pparam, priv, desc_rngcnt_idx);
+	init_pparam(pparam, priv, desc_rngcnt_idx, node);
 	ppool = page_pool_create(pparam);	// Only ring is initialized, pages are not allocated yet.
-	if (!ppool)
-		goto clear_rx_queue;
+	if (IS_ERR(ppool)) {
+		rv = PTR_ERR(ppool);
+		goto free_rx_queue;
+	}
 	q->ppool = ppool;
-	q->pparam = pparam;
 
-	err = xdp_rxq_info_reg(&q->xdp_rxq, q->netdev, q->qid, 0);
-	if (err) {
+	rv = xdp_rxq_info_reg(&q->xdp_rxq, q->netdev, q->qid, 0);
+	if (rv < 0) {
 		netdev_info(dev, "Failed to register device and queue for xdp");
-		goto clear_rx_queue;
+		goto free_rx_queue;
 	}
 
-	err = xdp_rxq_info_reg_mem_model(&q->xdp_rxq, MEM_TYPE_PAGE_POOL, q->ppool);
-	if (err) {
+	rv = xdp_rxq_info_reg_mem_model(&q->xdp_rxq, MEM_TYPE_PAGE_POOL, q->ppool);
+	if (rv < 0) {
 		netdev_info(dev, "Failed to register driver memory model with xdp");
-		goto clear_rx_queue;
+		goto free_rx_queue;
 	}
 
 	netdev_info(dev, "page pool size, order onic_rx_queue %d %d ", q->pparam->pool_size, q->pparam->order);
@@ -654,7 +1366,7 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 					GFP_KERNEL);
 	if (!ring->desc) {
 		rv = -ENOMEM;
-		goto clear_rx_queue;
+		goto free_rx_queue;
 	}
 	netdev_info(dev, "Allocated memory for ring->desc ");
 	memset(ring->desc, 0, size);
@@ -665,36 +1377,29 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 
 	/* initialize RX buffers */
 	q->buffer =
-		kcalloc(real_count, sizeof(struct onic_rx_buffer), GFP_KERNEL);
+		kcalloc_node(real_count, sizeof(struct onic_rx_buffer),
+			     GFP_KERNEL, node);
 	if (!q->buffer) {
 		rv = -ENOMEM;
-		goto clear_rx_queue;
+		goto free_rx_queue;
 	}
 	netdev_info(dev, "Allocated memory for q->buffer ");
 
 	for (i = 0; i < real_count; ++i) {
-		struct page *pg = page_pool_dev_alloc_pages(q->ppool);
-		if (!pg) {
-			rv = -ENOMEM;
-			goto clear_rx_queue;
-		}
-		//netdev_info(dev, "Allocated memory for page %d ", i);
-
-		q->buffer[i].pg = pg;
-		q->buffer[i].offset = q->pparam->offset;
+		rv = onic_rx_alloc_buffer(q, &q->buffer[i]);
+		if (rv < 0)
+			goto free_rx_queue;
 	}
 	netdev_info(dev, "Allocated memory for %d pages ", real_count);
 
-	/* map pages and initialize descriptors */
+	/* initialize descriptors, the page pool has mapped the pages */
 	for (i = 0; i < real_count; ++i) {
 		u8 *desc_ptr = ring->desc + QDMA_C2H_ST_DESC_SIZE * i;
 		struct qdma_c2h_st_desc desc;
 		struct page *pg = q->buffer[i].pg;
 		unsigned int offset = q->buffer[i].offset;
 
-		desc.dst_addr = dma_map_page(&priv->pdev->dev, pg, 0, PAGE_SIZE,
-					     DMA_FROM_DEVICE);
-		desc.dst_addr += offset;
+		desc.dst_addr = page_pool_get_dma_addr(pg) + offset;
 
 		qdma_pack_c2h_st_desc(desc_ptr, &desc);
 	}
@@ -710,7 +1415,7 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 					GFP_KERNEL);
 	if (!ring->desc) {
 		rv = -ENOMEM;
-		goto clear_rx_queue;
+		goto free_rx_queue;
 	}
 	netdev_info(dev, "Allocated memory for completion ring ");
 	memset(ring->desc, 0, size);
@@ -743,7 +1448,7 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 
 	rv = onic_qdma_init_rx_queue(priv->hw.qdma, qid, &param);
 	if (rv < 0)
-		goto clear_rx_queue;
+		goto del_napi;
 
 	/* fill RX descriptor ring with a few descriptors */
 	q->desc_ring.next_to_use = ONIC_RX_DESC_STEP;
@@ -753,9 +1458,11 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 	priv->rx_queue[qid] = q;
 	return 0;
 
-clear_rx_queue:
-	onic_clear_rx_queue(priv, qid);
-
+del_napi:
+	napi_disable(&q->napi);
+	netif_napi_del(&q->napi);
+free_rx_queue:
+	onic_free_rx_queue(priv, q);
 	return rv;
 }
 
@@ -812,6 +1519,13 @@ int onic_open_netdev(struct net_device *dev)
 	if (rv < 0)
 		goto stop_netdev;
 
+	/* XDP TX queues must exist before NAPI can run the program */
+	if (priv->prog) {
+		rv = onic_init_xdp_tx_resource(priv);
+		if (rv < 0)
+			goto stop_netdev;
+	}
+
 	rv = onic_init_rx_resource(priv);
 	if (rv < 0)
 		goto stop_netdev;
@@ -838,8 +1552,402 @@ int onic_stop_netdev(struct net_device *dev)
 		onic_clear_tx_queue(priv, qid);
 	for (qid = 0; qid < priv->num_rx_queues; ++qid)
 		onic_clear_rx_queue(priv, qid);
+	/* NAPI is gone, nobody can post to the XDP TX queues anymore */
+	onic_clear_xdp_tx_resource(priv);
+
+	return 0;
+}
+
+/**
+ * onic_tx_post - write one H2C descriptor at the head of a TX ring
+ * @q: TX queue
+ * @dma_addr: DMA address of the buffer
+ * @len: length of the buffer
+ * @metadata: packet metadata passed to the user logic
+ * @type: how the buffer has been mapped
+ * @sop: first descriptor of the packet
+ * @eop: last descriptor of the packet
+ *
+ * The caller makes sure the ring has room.  Return the bookkeeping entry of
+ * the descriptor, with its skb/xdpf pointer cleared.
+ **/
+static struct onic_tx_buffer *onic_tx_post(struct onic_tx_queue *q,
+					   dma_addr_t dma_addr, u32 len,
+					   u32 metadata, u32 type,
+					   bool sop, bool eop)
+{
+	struct onic_ring *ring = &q->ring;
+	struct onic_tx_buffer *buf = &q->buffer[ring->next_to_use];
+	struct qdma_h2c_st_desc desc;
+	u8 *desc_ptr;
+
+	desc_ptr = ring->desc + QDMA_H2C_ST_DESC_SIZE * ring->next_to_use;
+	desc.len = len;
+	desc.src_addr = dma_addr;
+	desc.metadata = metadata;
+	desc.sop = sop;
+	desc.eop = eop;
+	qdma_pack_h2c_st_desc(desc_ptr, &desc);
+
+	buf->skb = NULL;
+	buf->dma_addr = dma_addr;
+	buf->len = len;
+	buf->type = type;
+	buf->bytes = 0;
+	buf->packets = 0;
+
+	onic_ring_increment_head(ring);
+	return buf;
+}
+
+/**
+ * onic_tx_metadata - descriptor metadata of a packet built from an skb
+ * @priv: pointer to driver private data
+ * @q: TX queue the packet goes to
+ * @skb: packet being sent
+ * @len: length on the wire of the packet, or of the TSO segment
+ **/
+static u32 onic_tx_metadata(struct onic_private *priv, struct onic_tx_queue *q,
+			    const struct sk_buff *skb, u32 len)
+{
+	switch (READ_ONCE(priv->tx_metadata)) {
+	case ONIC_TX_META_MARK:
+		return skb->mark;
+	case ONIC_TX_META_PRIORITY:
+		return skb->priority;
+	case ONIC_TX_META_QUEUE:
+		return q->qid;
+	default:
+		return len;
+	}
+}
+
+/**
+ * onic_xdp_tx_metadata - descriptor metadata of an XDP frame
+ * @priv: pointer to driver private data
+ * @q: XDP TX queue the frame goes to
+ * @xdpf: frame being sent
+ *
+ * With the "xdp" source, the program provides the word through
+ * bpf_xdp_adjust_meta(): it is the u32 right in front of the packet data.
+ * Frames have no mark or priority, those sources yield 0.
+ **/
+static u32 onic_xdp_tx_metadata(struct onic_private *priv,
+				struct onic_tx_queue *q,
+				const struct xdp_frame *xdpf)
+{
+	switch (READ_ONCE(priv->tx_metadata)) {
+	case ONIC_TX_META_MARK:
+	case ONIC_TX_META_PRIORITY:
+		return 0;
+	case ONIC_TX_META_QUEUE:
+		return q->qid;
+	case ONIC_TX_META_XDP:
+		if (xdpf->metasize >= sizeof(u32))
+			return get_unaligned((const u32 *)xdpf->data - 1);
+		return xdpf->len;
+	default:
+		return xdpf->len;
+	}
+}
+
+/**
+ * onic_tx_map_skb - map an skb and post one descriptor per buffer
+ * @priv: pointer to driver private data
+ * @q: TX queue with at least nr_frags + 1 free descriptors
+ * @skb: packet to transmit
+ *
+ * The linear part and every page fragment get a descriptor of their own.
+ * Return 0 on success.  On a mapping failure nothing is left mapped, the ring
+ * head is restored and a negative value is returned.
+ **/
+static int onic_tx_map_skb(struct onic_private *priv, struct onic_tx_queue *q,
+			   struct sk_buff *skb)
+{
+	struct device *dma_dev = &priv->pdev->dev;
+	struct onic_ring *ring = &q->ring;
+	unsigned int nr_frags = skb_shinfo(skb)->nr_frags;
+	unsigned int headlen = skb_headlen(skb);
+	struct onic_tx_buffer *buf = NULL;
+	u16 first = ring->next_to_use;
+	u32 meta = onic_tx_metadata(priv, q, skb, skb->len);
+	dma_addr_t dma_addr;
+	bool sop = true;
+	int i;
+
+	if (headlen) {
+		dma_addr = dma_map_single(dma_dev, skb->data, headlen,
+					  DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(dma_dev, dma_addr)))
+			return -ENOMEM;
+
+		buf = onic_tx_post(q, dma_addr, headlen, meta, ONIC_SKB_BUFF,
+				   sop, nr_frags == 0);
+		sop = false;
+	}
+
+	for (i = 0; i < nr_frags; ++i) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		unsigned int len = skb_frag_size(frag);
+
+		dma_addr = skb_frag_dma_map(dma_dev, frag, 0, len,
+					    DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(dma_dev, dma_addr)))
+			goto unmap;
+
+		buf = onic_tx_post(q, dma_addr, len, meta, ONIC_SKB_FRAG,
+				   sop, i == nr_frags - 1);
+		sop = false;
+	}
+
+	/* freed once the descriptor carrying EOP completes */
+	buf->skb = skb;
+	return 0;
+
+unmap:
+	while (ring->next_to_use != first) {
+		onic_tx_unmap(priv, &q->buffer[first]);
+		first = (first + 1) % onic_ring_get_real_count(ring);
+	}
+	ring->next_to_use = first;
+	return -ENOMEM;
+}
+
+/**
+ * onic_tx_copy - send a small packet from the TX slot of its descriptor
+ * @priv: pointer to driver private data
+ * @q: TX queue with at least one free descriptor
+ * @skb: packet to transmit, no longer than the TX slot size
+ *
+ * The slots stay DMA-mapped for the lifetime of the queue, so copying saves
+ * a map and an unmap, which dominate small-packet cost behind an IOMMU.  The
+ * skb is consumed right away.  Return the length put on the wire.
+ **/
+static unsigned int onic_tx_copy(struct onic_private *priv,
+				 struct onic_tx_queue *q, struct sk_buff *skb)
+{
+	u16 idx = q->ring.next_to_use;
+	u8 *slot = q->slots + priv->tx_slot_size * idx;
+	unsigned int len = skb->len;
+
+	/* also fills in the checksum of CHECKSUM_PARTIAL skbs */
+	skb_copy_and_csum_dev(skb, slot);
+	if (len < ETH_ZLEN) {
+		memset(slot + len, 0, ETH_ZLEN - len);
+		len = ETH_ZLEN;
+	}
+
+	onic_tx_post(q, q->slots_dma + priv->tx_slot_size * idx, len,
+		     onic_tx_metadata(priv, q, skb, len), ONIC_TX_NOMAP,
+		     true, true);
+	dev_consume_skb_any(skb);
+	return len;
+}
+
+static unsigned int onic_tso_hdr_len(const struct sk_buff *skb)
+{
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return skb_transport_offset(skb) + sizeof(struct udphdr);
+	return skb_transport_offset(skb) + tcp_hdrlen(skb);
+}
+
+/**
+ * onic_tso_csum - fill in the IP and L4 checksums of one TSO segment
+ * @skb: GSO skb the segment is cut from
+ * @tso: TSO state, for the IP version
+ * @hdr: headers of the segment, as built by tso_build_hdr()
+ * @hdr_len: length of @hdr
+ * @seg_len: payload length of the segment
+ * @csum: checksum of the payload
+ *
+ * The shell does not offload checksums, so they are computed here while the
+ * payload itself still goes to the device by DMA reference.
+ **/
+static void onic_tso_csum(const struct sk_buff *skb, const struct tso_t *tso,
+			  u8 *hdr, int hdr_len, int seg_len, __wsum csum)
+{
+	int l4_off = skb_transport_offset(skb);
+	int l4_len = hdr_len - l4_off + seg_len;
+	bool udp = skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4;
+	u8 proto = udp ? IPPROTO_UDP : IPPROTO_TCP;
+	__sum16 *check;
+	__sum16 sum;
+
+	if (udp)
+		check = &((struct udphdr *)(hdr + l4_off))->check;
+	else
+		check = &((struct tcphdr *)(hdr + l4_off))->check;
+
+	/* the copied header holds the pseudo-header sum of CHECKSUM_PARTIAL */
+	*check = 0;
+	csum = csum_add(csum_partial(hdr + l4_off, hdr_len - l4_off, 0), csum);
+
+	if (tso->ipv6) {
+		struct ipv6hdr *ip6h =
+			(struct ipv6hdr *)(hdr + skb_network_offset(skb));
+
+		sum = csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr, l4_len,
+				      proto, csum);
+	} else {
+		struct iphdr *iph =
+			(struct iphdr *)(hdr + skb_network_offset(skb));
+
+		ip_send_check(iph);
+		sum = csum_tcpudp_magic(iph->saddr, iph->daddr, l4_len, proto,
+					csum);
+	}
+
+	if (udp && !sum)
+		sum = CSUM_MANGLED_0;
+	*check = sum;
+}
+
+/**
+ * onic_tx_tso - segment a GSO skb straight into the H2C ring
+ * @priv: pointer to driver private data
+ * @q: TX queue with room for onic_tx_desc_count() descriptors
+ * @skb: GSO skb, TCP or UDP
+ *
+ * Every segment is one packet made of a header descriptor, pointing to the
+ * TX slot of that descriptor, followed by descriptors referencing the payload
+ * in place.  The linear part and the fragments are mapped once; the entry of
+ * the last descriptor using a mapping owns it and unmaps it on completion.
+ * Return 0 on success, negative if a mapping failed, in which case nothing
+ * has been posted.
+ **/
+static int onic_tx_tso(struct onic_private *priv, struct onic_tx_queue *q,
+		       struct sk_buff *skb)
+{
+	struct device *dma_dev = &priv->pdev->dev;
+	struct onic_ring *ring = &q->ring;
+	unsigned int nr_frags = skb_shinfo(skb)->nr_frags;
+	dma_addr_t dma[MAX_SKB_FRAGS + 1];
+	unsigned int map_len[MAX_SKB_FRAGS + 1];
+	struct onic_tx_buffer *buf = NULL;
+	int hdr_len, total_len, i;
+	struct tso_t tso;
+
+	hdr_len = tso_start(skb, &tso);
+	total_len = skb->len - hdr_len;
+
+	/* headers come from the TX slots, only the payload is mapped */
+	map_len[0] = skb_headlen(skb) - hdr_len;
+	if (map_len[0]) {
+		dma[0] = dma_map_single(dma_dev, skb->data + hdr_len,
+					map_len[0], DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(dma_dev, dma[0])))
+			return -ENOMEM;
+	}
+	for (i = 0; i < nr_frags; ++i) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		map_len[i + 1] = skb_frag_size(frag);
+		dma[i + 1] = skb_frag_dma_map(dma_dev, frag, 0, map_len[i + 1],
+					      DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(dma_dev, dma[i + 1])))
+			goto unmap;
+	}
+
+	while (total_len > 0) {
+		u16 idx = ring->next_to_use;
+		u8 *hdr = q->slots + priv->tx_slot_size * idx;
+		dma_addr_t hdr_dma = q->slots_dma + priv->tx_slot_size * idx;
+		int seg_len = min_t(int, skb_shinfo(skb)->gso_size, total_len);
+		int pad = max_t(int, ETH_ZLEN - hdr_len - seg_len, 0);
+		int pkt_len = hdr_len + seg_len + pad;
+		u32 meta = onic_tx_metadata(priv, q, skb, pkt_len);
+		int data_left = seg_len;
+		__wsum csum = 0;
+
+		total_len -= seg_len;
+		tso_build_hdr(skb, hdr, &tso, seg_len, total_len == 0);
+		onic_tx_post(q, hdr_dma, hdr_len, meta, ONIC_TX_NOMAP, true,
+			     false);
+
+		while (data_left > 0) {
+			/* 0 is the linear part, n is fragment n - 1 */
+			int m = tso.next_frag_idx;
+			int size = min_t(int, tso.size, data_left);
+			void *base = m ? skb_frag_address(&skb_shinfo(skb)->frags[m - 1]) :
+					 skb->data + hdr_len;
+			unsigned int off = (u8 *)tso.data - (u8 *)base;
+
+			csum = csum_block_add(csum, csum_partial(tso.data, size, 0),
+					      seg_len - data_left);
+			data_left -= size;
+
+			buf = onic_tx_post(q, dma[m] + off, size, meta,
+					   ONIC_TX_NOMAP, false,
+					   data_left == 0 && !pad);
+			if (off + size == map_len[m]) {
+				/* last use of the mapping */
+				buf->type = m ? ONIC_SKB_FRAG : ONIC_SKB_BUFF;
+				buf->dma_addr = dma[m];
+				buf->len = map_len[m];
+			}
+
+			tso_build_data(skb, &tso, size);
+		}
+
+		onic_tso_csum(skb, &tso, hdr, hdr_len, seg_len, csum);
+
+		if (pad) {
+			/* runt segment, pad it from the rest of the slot */
+			memset(hdr + hdr_len, 0, pad);
+			buf = onic_tx_post(q, hdr_dma + hdr_len, pad, meta,
+					   ONIC_TX_NOMAP, false, true);
+		}
+	}
 
+	/* freed once the last descriptor completes */
+	buf->skb = skb;
 	return 0;
+
+unmap:
+	while (i--)
+		dma_unmap_page(dma_dev, dma[i + 1], map_len[i + 1],
+			       DMA_TO_DEVICE);
+	if (map_len[0])
+		dma_unmap_single(dma_dev, dma[0], map_len[0], DMA_TO_DEVICE);
+	return -ENOMEM;
+}
+
+/**
+ * onic_tx_desc_count - worst-case number of descriptors needed by an skb
+ * @skb: packet to transmit
+ *
+ * A TSO segment takes a header descriptor plus one descriptor per payload
+ * piece, and a piece ends either at a segment or at a mapping boundary.  The
+ * last segment may take one more for padding; onic_features_check() keeps
+ * all the others at least ETH_ZLEN long.  Never more than ONIC_TX_DESC_MAX.
+ **/
+static unsigned int onic_tx_desc_count(const struct sk_buff *skb)
+{
+	unsigned int nr_frags = skb_shinfo(skb)->nr_frags;
+
+	if (!skb_is_gso(skb))
+		return nr_frags + 1;
+	return 2 * skb_shinfo(skb)->gso_segs + nr_frags + 2;
+}
+
+netdev_features_t onic_features_check(struct sk_buff *skb,
+				      struct net_device *dev,
+				      netdev_features_t features)
+{
+	struct onic_private *priv = netdev_priv(dev);
+
+	if (!skb_is_gso(skb))
+		return features;
+
+	/* The headers of a segment must fit in a TX slot, the segments in a
+	 * reasonable share of the ring, and only the last one may be a runt.
+	 */
+	if (onic_tso_hdr_len(skb) > priv->tx_slot_size ||
+	    skb_shinfo(skb)->gso_segs > ONIC_TSO_MAX_SEGS ||
+	    onic_tso_hdr_len(skb) + skb_shinfo(skb)->gso_size < ETH_ZLEN)
+		features &= ~NETIF_F_GSO_MASK;
+
+	return features;
 }
 
 netdev_tx_t onic_xmit_frame(struct sk_buff *skb, struct net_device *dev)
@@ -847,69 +1955,130 @@ netdev_tx_t onic_xmit_frame(struct sk_buff *skb, struct net_device *dev)
 	struct onic_private *priv = netdev_priv(dev);
 	struct onic_tx_queue *q;
 	struct onic_ring *ring;
-	struct qdma_h2c_st_desc desc;
+	struct onic_tx_buffer *last;
 	u16 qid = skb->queue_mapping;
-	dma_addr_t dma_addr;
-	u8 *desc_ptr;
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, qid);
+	unsigned int packets = 1;
+	unsigned int bytes;
+	unsigned int maps = 0;
+	bool xmit_more;
+	bool copied = false;
 	int rv;
 	bool debug = 0;
 
+	/* sampled up front, small packets are freed before the doorbell */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	xmit_more = netdev_xmit_more();
+#elif defined(RHEL_RELEASE_CODE)
+#if RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(8, 1)
+	xmit_more = netdev_xmit_more();
+#endif
+#else
+	xmit_more = skb->xmit_more;
+#endif
+
 	q = priv->tx_queue[qid];
 	ring = &q->ring;
 
-	onic_tx_clean(q);
-
-	if (onic_ring_full(ring)) {
+	if (unlikely(onic_ring_get_free(ring) < onic_tx_desc_count(skb))) {
+		/* cannot happen, the queue is stopped ahead of time */
 		if (debug)
 			netdev_info(dev, "ring is full");
+		netif_tx_stop_queue(txq);
 		return NETDEV_TX_BUSY;
 	}
 
-	/* minimum Ethernet packet length is 60 */
-	rv = skb_put_padto(skb, ETH_ZLEN);
-
-	if (rv < 0)
-		netdev_err(dev, "skb_put_padto failed, err = %d", rv);
-
-	dma_addr = dma_map_single(&priv->pdev->dev, skb->data, skb->len,
-				  DMA_TO_DEVICE);
+	if (skb_is_gso(skb)) {
+		/* every segment but the first one repeats the headers */
+		packets = skb_shinfo(skb)->gso_segs;
+		bytes = skb->len + (packets - 1) * onic_tso_hdr_len(skb);
+		/* the headers are built in the slots, only the payload is mapped */
+		maps = skb_shinfo(skb)->nr_frags +
+		       (skb_headlen(skb) > onic_tso_hdr_len(skb));
+		rv = onic_tx_tso(priv, q, skb);
+	} else if (skb->len <= READ_ONCE(priv->tx_copybreak) &&
+		   !(skb_shinfo(skb)->tx_flags & SKBTX_ANY_TSTAMP)) {
+		/* copied skbs are freed at once, stamped ones are kept */
+		bytes = onic_tx_copy(priv, q, skb);
+		copied = true;
+		rv = 0;
+	} else {
+		/* minimum Ethernet packet length is 60 */
+		rv = skb_put_padto(skb, ETH_ZLEN);
+		if (rv < 0) {
+			/* the skb has been freed */
+			u64_stats_update_begin(&priv->tx_stats[qid].syncp);
+			priv->tx_stats[qid].dropped++;
+			u64_stats_update_end(&priv->tx_stats[qid].syncp);
+			return NETDEV_TX_OK;
+		}
 
-	if (unlikely(dma_mapping_error(&priv->pdev->dev, dma_addr))) {
-		dev_kfree_skb(skb);
-		priv->netdev_stats.tx_dropped++;
-		priv->netdev_stats.tx_errors++;
-		/* Why is this returing TX_OK when it has failed ? */
+		bytes = skb->len;
+		/* checksum offload is advertised for TSO only */
+		if (skb->ip_summed == CHECKSUM_PARTIAL)
+			rv = skb_checksum_help(skb);
+		if (!rv) {
+			maps = skb_shinfo(skb)->nr_frags + !!skb_headlen(skb);
+			rv = onic_tx_map_skb(priv, q, skb);
+		}
+	}
+	if (unlikely(rv < 0)) {
+		dev_kfree_skb_any(skb);
+		u64_stats_update_begin(&priv->tx_stats[qid].syncp);
+		priv->tx_stats[qid].dropped++;
+		priv->tx_stats[qid].errors++;
+		u64_stats_update_end(&priv->tx_stats[qid].syncp);
+		/* the packet is consumed, there is no point in a requeue */
 		return NETDEV_TX_OK;
 	}
 
-	desc_ptr = ring->desc + QDMA_H2C_ST_DESC_SIZE * ring->next_to_use;
-	desc.len = skb->len;
-	desc.src_addr = dma_addr;
-	desc.metadata = skb->len;
-	qdma_pack_h2c_st_desc(desc_ptr, &desc);
+	u64_stats_update_begin(&priv->tx_stats[qid].syncp);
+	priv->tx_stats[qid].packets += packets;
+	priv->tx_stats[qid].bytes += bytes;
+	priv->tx_stats[qid].dma_maps += maps;
+	u64_stats_update_end(&priv->tx_stats[qid].syncp);
+
+	/* completion reports these to BQL */
+	last = &q->buffer[(ring->next_to_use + onic_ring_get_real_count(ring) - 1) %
+			  onic_ring_get_real_count(ring)];
+	last->bytes = bytes;
+	last->packets = packets;
+
+	onic_tx_arm_timer(priv, q);
+
+	/* stop while the worst-case packet still fits */
+	if (unlikely(onic_ring_get_free(ring) < ONIC_TX_DESC_MAX)) {
+		netif_tx_stop_queue(txq);
+		/* pairs with the barrier in onic_tx_clean() */
+		smp_mb();
+		if (onic_ring_get_free(ring) >= ONIC_TX_DESC_MAX)
+			netif_tx_start_queue(txq);
+	}
 
-	q->buffer[ring->next_to_use].skb = skb;
-	q->buffer[ring->next_to_use].dma_addr = dma_addr;
-	q->buffer[ring->next_to_use].len = skb->len;
-	q->buffer[ring->next_to_use].type = ONIC_SKB_BUFF;
+	if (q->rate_mbps) {
+		u64 wait = onic_tx_rate_charge(q, bytes);
 
-	priv->netdev_stats.tx_packets++;
-	priv->netdev_stats.tx_bytes += skb->len;
+		if (wait) {
+			/* woken by the rate timer, not by ring reclaim */
+			set_bit(ONIC_TX_THROTTLED, q->state);
+			netif_tx_stop_queue(txq);
+			hrtimer_start(&q->rate_timer, ns_to_ktime(wait),
+				      HRTIMER_MODE_REL);
+		}
+	}
 
-	onic_ring_increment_head(ring);
+	/* The hardware cannot complete the descriptors, and reclaim cannot
+	 * free the skb, before the doorbell below: stamp as late as is safe.
+	 * Copied skbs are gone, but those asking for a stamp are never copied.
+	 */
+	if (!copied)
+		skb_tx_timestamp(skb);
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
-	if (onic_ring_full(ring) || !netdev_xmit_more()) {
-#elif defined(RHEL_RELEASE_CODE) 
-#if RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(8, 1)
-        if (onic_ring_full(ring) || !netdev_xmit_more()) {
-#endif
-#else
-	if (onic_ring_full(ring) || !skb->xmit_more) {
-#endif
-		wmb();
-		onic_set_tx_head(priv->hw.qdma, qid, ring->next_to_use);
-	}
+	/* asks for the doorbell too when the queue is stopped, by BQL or
+	 * above, in which case it cannot wait for more packets
+	 */
+	if (__netdev_tx_sent_queue(txq, bytes, xmit_more))
+		onic_tx_kick(priv, q, netif_xmit_stopped(txq));
 
 	return NETDEV_TX_OK;
 }
@@ -919,62 +2088,131 @@ int onic_xmit_xdp_frame(struct xdp_frame *xdpf, struct net_device *dev, int rx_q
 	struct onic_private *priv = netdev_priv(dev);
 	struct onic_tx_queue *q;
 	struct onic_ring *ring;
-	struct netdev_queue *nq;
-	struct page *page = virt_to_page(xdpf->data);
-	struct qdma_h2c_st_desc desc;
-	u16 qid = rx_qid;
+	/* the pool maps, and records the DMA address of, head pages only */
+	struct page *page = virt_to_head_page(xdpf->data);
+	struct onic_tx_buffer *buf;
 	dma_addr_t dma_addr;
-	u8 *desc_ptr;
 	bool debug = 0;
 
-	q = priv->tx_queue[qid];
-	nq = netdev_get_tx_queue(dev, qid);
-	__netif_tx_lock(nq, raw_smp_processor_id());
+	/* owned by the NAPI context of rx_qid, no locking required */
+	q = priv->xdp_tx_queue[rx_qid];
 	ring = &q->ring;
 
-	onic_tx_clean(q);
-
 	if (onic_ring_full(ring)) {
 		if (debug)
 			netdev_info(dev, "ring is full");
-		xdp_return_frame_rx_napi(xdpf);	
-		__netif_tx_unlock(nq);
+		xdp_return_frame_rx_napi(xdpf);
 		return -1;
 	}
 	/* How does XDP frame ensure min length of 64 Bytes ? */
-	dma_addr = page_pool_get_dma_addr(page) + sizeof(*xdpf) + xdpf->headroom;
+	/* the page pool keeps the page mapped, no need to map it again */
+	dma_addr = page_pool_get_dma_addr(page) +
+		   ((u8 *)xdpf->data - (u8 *)page_address(page));
 	dma_sync_single_for_device(&priv->pdev->dev, dma_addr, xdpf->len,
 				  DMA_BIDIRECTIONAL);
 
-	desc_ptr = ring->desc + QDMA_H2C_ST_DESC_SIZE * ring->next_to_use;
-	desc.len = xdpf->len;
-	desc.src_addr = dma_addr;
-	desc.metadata = xdpf->len;
-	qdma_pack_h2c_st_desc(desc_ptr, &desc);
+	buf = onic_tx_post(q, dma_addr, xdpf->len,
+			   onic_xdp_tx_metadata(priv, q, xdpf), ONIC_XDP_FRAME,
+			   true, true);
+	buf->xdpf = xdpf;
+	return 0;
+}
 
-	q->buffer[ring->next_to_use].xdpf = xdpf;
-	q->buffer[ring->next_to_use].dma_addr = dma_addr;
-	q->buffer[ring->next_to_use].len = xdpf->len;
-	q->buffer[ring->next_to_use].type = ONIC_XDP_FRAME;
+void onic_xdp_tx_flush(struct net_device *dev, int rx_qid)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct onic_tx_queue *q = priv->xdp_tx_queue[rx_qid];
 
-	priv->xdp_stats.xdp_txed++;
-	netdev_info(dev, "XDP txed = %llu", priv->xdp_stats.xdp_txed);
+	onic_tx_kick(priv, q, false);
+}
 
-	onic_ring_increment_head(ring);
+/**
+ * onic_setup_mqprio - partition the TX queues into traffic classes
+ * @dev: pointer to registered net device
+ * @mqprio: mqprio offload request
+ *
+ * Each traffic class owns a contiguous range of TX queues, and therefore of
+ * H2C rings, so a class never waits behind descriptors of another one.  The
+ * stack maps skb->priority to a class and hashes within its range.
+ **/
+static int onic_setup_mqprio(struct net_device *dev,
+			     struct tc_mqprio_qopt_offload *mqprio)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct tc_mqprio_qopt *qopt = &mqprio->qopt;
+	u16 next = 0;
+	int tc, prio, rv;
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
-	if (onic_ring_full(ring) || !netdev_xmit_more()) {
-#elif defined(RHEL_RELEASE_CODE) 
-#if RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(8, 1)
-        if (onic_ring_full(ring) || !netdev_xmit_more()) {
-#endif
-#else
-	if (onic_ring_full(ring) || !skb->xmit_more) {
-#endif
-		wmb();
-		onic_set_tx_head(priv->hw.qdma, qid, ring->next_to_use);
+	if (!qopt->num_tc) {
+		netdev_reset_tc(dev);
+		goto update_xps;
+	}
+
+	if (mqprio->mode != TC_MQPRIO_MODE_DCB ||
+	    mqprio->shaper != TC_MQPRIO_SHAPER_DCB)
+		return -EOPNOTSUPP;
+	if (qopt->num_tc > ONIC_MAX_TC)
+		return -EINVAL;
+
+	/* the ranges must tile the TX queues from queue 0, in class order */
+	for (tc = 0; tc < qopt->num_tc; ++tc) {
+		if (!qopt->count[tc] || qopt->offset[tc] != next)
+			return -EINVAL;
+		next += qopt->count[tc];
+	}
+	if (next > priv->num_tx_queues)
+		return -EINVAL;
+
+	rv = netdev_set_num_tc(dev, qopt->num_tc);
+	if (rv < 0)
+		return rv;
+	for (tc = 0; tc < qopt->num_tc; ++tc)
+		netdev_set_tc_queue(dev, tc, qopt->count[tc], qopt->offset[tc]);
+	for (prio = 0; prio <= TC_BITMASK; ++prio)
+		netdev_set_prio_tc_map(dev, prio, qopt->prio_tc_map[prio]);
+	qopt->hw = TC_MQPRIO_HW_OFFLOAD_TCS;
+
+update_xps:
+	/* changing the number of classes drops the XPS maps */
+	onic_update_affinity(priv);
+	return 0;
+}
+
+int onic_setup_tc(struct net_device *dev, enum tc_setup_type type,
+		  void *type_data)
+{
+	switch (type) {
+	case TC_SETUP_QDISC_MQPRIO:
+		return onic_setup_mqprio(dev, type_data);
+	default:
+		return -EOPNOTSUPP;
 	}
-	__netif_tx_unlock(nq);
+}
+
+int onic_set_tx_maxrate(struct net_device *dev, int queue_index, u32 maxrate)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct netdev_queue *txq;
+	struct onic_tx_queue *q;
+
+	if (queue_index < 0 || queue_index >= priv->num_tx_queues)
+		return -EINVAL;
+
+	priv->tx_maxrate[queue_index] = maxrate;
+
+	/* queues are created and destroyed under RTNL as well */
+	q = priv->tx_queue[queue_index];
+	if (!q)
+		return 0;
+
+	txq = netdev_get_tx_queue(dev, queue_index);
+	__netif_tx_lock_bh(txq);
+	onic_tx_rate_reset(q, maxrate);
+	/* let a paused queue go right away, the new bucket starts full */
+	if (test_bit(ONIC_TX_THROTTLED, q->state))
+		hrtimer_start(&q->rate_timer, 0, HRTIMER_MODE_REL);
+	__netif_tx_unlock_bh(txq);
+
 	return 0;
 }
 
@@ -992,9 +2230,39 @@ int onic_set_mac_address(struct net_device *dev, void *addr)
 	return 0;
 }
 
+static int onic_set_hwtstamp(struct net_device *dev, struct ifreq *ifr)
+{
+	struct hwtstamp_config config;
+
+	if (copy_from_user(&config, ifr->ifr_data, sizeof(config)))
+		return -EFAULT;
+
+	/* no flags are defined for this device */
+	if (config.flags)
+		return -EINVAL;
+
+	/* no PHC: the driver-side stamps are software ones, always on */
+	if (config.tx_type != HWTSTAMP_TX_OFF ||
+	    config.rx_filter != HWTSTAMP_FILTER_NONE)
+		return -ERANGE;
+
+	return copy_to_user(ifr->ifr_data, &config, sizeof(config)) ?
+		-EFAULT : 0;
+}
+
 int onic_do_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd)
 {
-	return 0;
+	struct hwtstamp_config config = {};
+
+	switch (cmd) {
+	case SIOCSHWTSTAMP:
+		return onic_set_hwtstamp(dev, ifr);
+	case SIOCGHWTSTAMP:
+		return copy_to_user(ifr->ifr_data, &config, sizeof(config)) ?
+			-EFAULT : 0;
+	default:
+		return -EOPNOTSUPP;
+	}
 }
 
 int onic_change_mtu(struct net_device *dev, int mtu)
@@ -1007,11 +2275,89 @@ inline void onic_get_stats64(struct net_device *dev,
 			     struct rtnl_link_stats64 *stats)
 {
 	struct onic_private *priv = netdev_priv(dev);
+	unsigned int start;
+	int qid;
+
+	for (qid = 0; qid < priv->num_rx_queues; qid++) {
+		const struct onic_rx_stats *rs = &priv->rx_stats[qid];
+		u64 packets, bytes;
+
+		do {
+			start = u64_stats_fetch_begin(&rs->syncp);
+			packets = rs->packets;
+			bytes = rs->bytes;
+		} while (u64_stats_fetch_retry(&rs->syncp, start));
+
+		stats->rx_packets += packets;
+		stats->rx_bytes += bytes;
+	}
+
+	for (qid = 0; qid < priv->num_tx_queues; qid++) {
+		const struct onic_tx_stats *ts = &priv->tx_stats[qid];
+		u64 packets, bytes, dropped, errors;
+
+		do {
+			start = u64_stats_fetch_begin(&ts->syncp);
+			packets = ts->packets;
+			bytes = ts->bytes;
+			dropped = ts->dropped;
+			errors = ts->errors;
+		} while (u64_stats_fetch_retry(&ts->syncp, start));
+
+		stats->tx_packets += packets;
+		stats->tx_bytes += bytes;
+		stats->tx_dropped += dropped;
+		stats->tx_errors += errors;
+	}
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+static void onic_get_queue_stats_rx(struct net_device *dev, int idx,
+				    struct netdev_queue_stats_rx *stats)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	const struct onic_rx_stats *rs = &priv->rx_stats[idx];
+	unsigned int start;
+
+	do {
+		start = u64_stats_fetch_begin(&rs->syncp);
+		stats->packets = rs->packets;
+		stats->bytes = rs->bytes;
+		stats->alloc_fail = rs->alloc_fail;
+	} while (u64_stats_fetch_retry(&rs->syncp, start));
+}
+
+static void onic_get_queue_stats_tx(struct net_device *dev, int idx,
+				    struct netdev_queue_stats_tx *stats)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	const struct onic_tx_stats *ts = &priv->tx_stats[idx];
+	unsigned int start;
+
+	do {
+		start = u64_stats_fetch_begin(&ts->syncp);
+		stats->packets = ts->packets;
+		stats->bytes = ts->bytes;
+	} while (u64_stats_fetch_retry(&ts->syncp, start));
+}
 
-	stats->tx_packets = priv->netdev_stats.tx_packets;
-	stats->tx_bytes = priv->netdev_stats.tx_bytes;
-	stats->rx_packets = priv->netdev_stats.rx_packets;
-	stats->rx_bytes = priv->netdev_stats.rx_bytes;
-	stats->tx_dropped = priv->netdev_stats.tx_dropped;
-	stats->tx_errors = priv->netdev_stats.tx_errors;
+static void onic_get_base_stats(struct net_device *dev,
+				struct netdev_queue_stats_rx *rx,
+				struct netdev_queue_stats_tx *tx)
+{
+	/* counters live in priv and are indexed by queue id, so nothing is
+	 * lost when the rings are torn down
+	 */
+	rx->packets = 0;
+	rx->bytes = 0;
+	rx->alloc_fail = 0;
+	tx->packets = 0;
+	tx->bytes = 0;
 }
+
+const struct netdev_stat_ops onic_stat_ops = {
+	.get_queue_stats_rx = onic_get_queue_stats_rx,
+	.get_queue_stats_tx = onic_get_queue_stats_tx,
+	.get_base_stats = onic_get_base_stats,
+};
+#endif
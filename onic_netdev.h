@@ -17,6 +17,7 @@
 #ifndef __ONIC_NETDEV_H__
 #define __ONIC_NETDEV_H__
 
+#include <linux/version.h>
 #include <linux/netdevice.h>
 
 /**
@@ -39,10 +40,76 @@ int onic_stop_netdev(struct net_device *dev);
 
 netdev_tx_t onic_xmit_frame(struct sk_buff *skb, struct net_device *dev);
 
+/**
+ * onic_features_check - per-skb feature restrictions
+ * @skb: packet about to be transmitted
+ * @dev: pointer to registered net device
+ * @features: features the stack intends to use for @skb
+ *
+ * Implementation of `ndo_features_check` in `net_device_ops`.  GSO skbs that
+ * driver-side TSO cannot handle are segmented by the stack instead.
+ **/
+netdev_features_t onic_features_check(struct sk_buff *skb,
+				      struct net_device *dev,
+				      netdev_features_t features);
+
+/**
+ * onic_xmit_xdp_frame - queue an XDP frame on the XDP TX queue of an RX queue
+ * @xdpf: XDP frame to transmit
+ * @dev: pointer to registered net device
+ * @qid: RX queue ID whose NAPI context is calling
+ *
+ * The doorbell is not rung; call onic_xdp_tx_flush() once the batch is
+ * queued.  Return 0 on success, negative if the ring is full, in which case
+ * the frame's page has been returned.
+ **/
 int onic_xmit_xdp_frame(struct xdp_frame *xdpf, struct net_device *dev, int qid);
 
+/**
+ * onic_xdp_tx_flush - ring the doorbell of the XDP TX queue of an RX queue
+ * @dev: pointer to registered net device
+ * @qid: RX queue ID whose NAPI context is calling
+ **/
+void onic_xdp_tx_flush(struct net_device *dev, int qid);
+
+/**
+ * onic_setup_tc - configure traffic control offloads
+ * @dev: pointer to registered net device
+ * @type: offload type
+ * @type_data: offload request
+ *
+ * Implementation of `ndo_setup_tc` in `net_device_ops`.  Only mqprio is
+ * supported; it splits the TX queues into per traffic class ranges.  Return
+ * 0 on success, negative on failure.
+ **/
+int onic_setup_tc(struct net_device *dev, enum tc_setup_type type,
+		  void *type_data);
+
+/**
+ * onic_set_tx_maxrate - cap the transmit rate of a TX queue
+ * @dev: pointer to registered net device
+ * @queue_index: TX queue ID
+ * @maxrate: rate in Mbps, 0 to remove the cap
+ *
+ * Implementation of `ndo_set_tx_maxrate` in `net_device_ops`.  The cap is
+ * enforced by a token bucket in the xmit path and kept across ifdown.
+ * Return 0 on success, negative on failure.
+ **/
+int onic_set_tx_maxrate(struct net_device *dev, int queue_index, u32 maxrate);
+
 int onic_set_mac_address(struct net_device *dev, void *addr);
 
+/**
+ * onic_do_ioctl - handle device ioctls
+ * @dev: pointer to registered net device
+ * @ifr: request, with the user pointer in ifr_data
+ * @cmd: ioctl number
+ *
+ * Implementation of `ndo_do_ioctl` and `ndo_eth_ioctl` in `net_device_ops`.
+ * SIOCSHWTSTAMP and SIOCGHWTSTAMP only accept and report hardware
+ * timestamping off, the device having no clock of its own.
+ * Return 0 on success, -EOPNOTSUPP for any other ioctl, negative on failure.
+ **/
 int onic_do_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd);
 
 int onic_change_mtu(struct net_device *dev, int mtu);
@@ -52,4 +119,12 @@ void onic_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats);
 int onic_poll(struct napi_struct *napi, int budget);
 
 int onic_xdp(struct net_device *dev, struct netdev_bpf *bpf);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+extern const struct xdp_metadata_ops onic_xdp_metadata_ops;
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+extern const struct netdev_stat_ops onic_stat_ops;
+#endif
 #endif
@@ -14,6 +14,68 @@
  * The full GNU General Public License is included in this distribution in
  * the file called "COPYING".
  */
+#include <linux/device.h>
+#include <linux/netdevice.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
 #include "onic.h"
 
-/* static ssize_t show */
+/* indexed by enum onic_tx_meta */
+static const char * const onic_tx_meta_names[] = {
+	[ONIC_TX_META_LEN] = "len",
+	[ONIC_TX_META_MARK] = "mark",
+	[ONIC_TX_META_PRIORITY] = "priority",
+	[ONIC_TX_META_QUEUE] = "queue",
+	[ONIC_TX_META_XDP] = "xdp",
+};
+
+static_assert(ARRAY_SIZE(onic_tx_meta_names) == ONIC_TX_META_MAX);
+
+/**
+ * tx_metadata - source of the metadata word of H2C descriptors
+ *
+ * Reading lists the sources with the active one in brackets.  The setting
+ * applies to packets queued after the write.
+ **/
+static ssize_t tx_metadata_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct onic_private *priv = netdev_priv(to_net_dev(dev));
+	u32 cur = READ_ONCE(priv->tx_metadata);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < ONIC_TX_META_MAX; i++)
+		len += sysfs_emit_at(buf, len, i == cur ? "%s[%s]" : "%s%s",
+				     i ? " " : "", onic_tx_meta_names[i]);
+	len += sysfs_emit_at(buf, len, "\n");
+
+	return len;
+}
+
+static ssize_t tx_metadata_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct onic_private *priv = netdev_priv(to_net_dev(dev));
+	int i;
+
+	i = sysfs_match_string(onic_tx_meta_names, buf);
+	if (i < 0)
+		return i;
+
+	WRITE_ONCE(priv->tx_metadata, i);
+	return count;
+}
+
+static DEVICE_ATTR_RW(tx_metadata);
+
+static struct attribute *onic_attrs[] = {
+	&dev_attr_tx_metadata.attr,
+	NULL
+};
+
+const struct attribute_group onic_attr_group = {
+	.attrs = onic_attrs,
+};
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM onic
+
+#if !defined(__ONIC_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __ONIC_TRACE_H__
+
+#include <linux/tracepoint.h>
+#include <linux/netdevice.h>
+
+#include "qdma_export.h"
+
+/* a NAPI poll of an RX queue starts: the completion status entry written
+ * back by the hardware, and the software view of the completion ring
+ */
+TRACE_EVENT(onic_rx_poll,
+	TP_PROTO(const struct net_device *dev, u16 qid,
+		 const struct qdma_c2h_cmpl_stat *stat, u16 ntc, u8 color),
+	TP_ARGS(dev, qid, stat, ntc, color),
+
+	TP_STRUCT__entry(
+		__array(char, name, IFNAMSIZ)
+		__field(u16, qid)
+		__field(u16, pidx)
+		__field(u16, cidx)
+		__field(u8, stat_color)
+		__field(u8, intr_state)
+		__field(u16, ntc)
+		__field(u8, color)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, dev->name, IFNAMSIZ);
+		__entry->qid = qid;
+		__entry->pidx = stat->pidx;
+		__entry->cidx = stat->cidx;
+		__entry->stat_color = stat->color;
+		__entry->intr_state = stat->intr_state;
+		__entry->ntc = ntc;
+		__entry->color = color;
+	),
+
+	TP_printk("%s rx%u: stat pidx %u cidx %u color %u intr_state %u, cmpl_ring next_to_clean %u color %u",
+		  __entry->name, __entry->qid, __entry->pidx, __entry->cidx,
+		  __entry->stat_color, __entry->intr_state, __entry->ntc,
+		  __entry->color)
+);
+
+/* a C2H completion entry is about to be processed */
+TRACE_EVENT(onic_rx_cmpl,
+	TP_PROTO(const struct net_device *dev, u16 qid,
+		 const struct qdma_c2h_cmpl *cmpl, u8 color),
+	TP_ARGS(dev, qid, cmpl, color),
+
+	TP_STRUCT__entry(
+		__array(char, name, IFNAMSIZ)
+		__field(u16, qid)
+		__field(u16, pkt_id)
+		__field(u16, pkt_len)
+		__field(u8, err)
+		__field(u8, cmpl_color)
+		__field(u8, color)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, dev->name, IFNAMSIZ);
+		__entry->qid = qid;
+		__entry->pkt_id = cmpl->pkt_id;
+		__entry->pkt_len = cmpl->pkt_len;
+		__entry->err = cmpl->err;
+		__entry->cmpl_color = cmpl->color;
+		__entry->color = color;
+	),
+
+	TP_printk("%s rx%u: pkt_id %u pkt_len %u err %u color %u, cmpl_ring color %u",
+		  __entry->name, __entry->qid, __entry->pkt_id,
+		  __entry->pkt_len, __entry->err, __entry->cmpl_color,
+		  __entry->color)
+);
+
+/* ring indexes after a completion entry has been consumed */
+TRACE_EVENT(onic_rx_ring,
+	TP_PROTO(const struct net_device *dev, u16 qid, u16 desc_ntu,
+		 u16 desc_ntc, u16 cmpl_ntc, bool flipped),
+	TP_ARGS(dev, qid, desc_ntu, desc_ntc, cmpl_ntc, flipped),
+
+	TP_STRUCT__entry(
+		__array(char, name, IFNAMSIZ)
+		__field(u16, qid)
+		__field(u16, desc_ntu)
+		__field(u16, desc_ntc)
+		__field(u16, cmpl_ntc)
+		__field(bool, flipped)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, dev->name, IFNAMSIZ);
+		__entry->qid = qid;
+		__entry->desc_ntu = desc_ntu;
+		__entry->desc_ntc = desc_ntc;
+		__entry->cmpl_ntc = cmpl_ntc;
+		__entry->flipped = flipped;
+	),
+
+	TP_printk("%s rx%u: desc_ring next_to_use %u next_to_clean %u, cmpl_ring next_to_clean %u flipped %d",
+		  __entry->name, __entry->qid, __entry->desc_ntu,
+		  __entry->desc_ntc, __entry->cmpl_ntc, __entry->flipped)
+);
+
+/* a NAPI poll of an RX queue returns */
+TRACE_EVENT(onic_rx_poll_done,
+	TP_PROTO(const struct net_device *dev, u16 qid, int work, int budget,
+		 u64 packets, u64 bytes, bool completed),
+	TP_ARGS(dev, qid, work, budget, packets, bytes, completed),
+
+	TP_STRUCT__entry(
+		__array(char, name, IFNAMSIZ)
+		__field(u16, qid)
+		__field(int, work)
+		__field(int, budget)
+		__field(u64, packets)
+		__field(u64, bytes)
+		__field(bool, completed)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, dev->name, IFNAMSIZ);
+		__entry->qid = qid;
+		__entry->work = work;
+		__entry->budget = budget;
+		__entry->packets = packets;
+		__entry->bytes = bytes;
+		__entry->completed = completed;
+	),
+
+	TP_printk("%s rx%u: work %d budget %d packets %llu bytes %llu napi_complete %d",
+		  __entry->name, __entry->qid, __entry->work, __entry->budget,
+		  __entry->packets, __entry->bytes, __entry->completed)
+);
+
+#endif /* __ONIC_TRACE_H__ */
+
+/* out of the kernel tree, found through the -I$(srcdir) of the Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE onic_trace
+#include <trace/define_trace.h>
@@ -15,10 +15,12 @@
  * the file called "COPYING".
  */
 #include "qdma_device.h"
+#include "qdma_register.h"
 
 struct qdma_dev *qdma_create_dev(struct pci_dev *pdev, u8 bar)
 {
 	struct qdma_dev *qdev;
+	resource_size_t len;
 
 	if (bar > 6) {
 		dev_err(&pdev->dev, "Bad BAR number %d", bar);
@@ -32,13 +34,35 @@ struct qdma_dev *qdma_create_dev(struct pci_dev *pdev, u8 bar)
 	qdev->pdev = pdev;
 	qdev->func_id = PCI_FUNC(pdev->devfn);
 
-	qdev->addr = pci_iomap(pdev, bar, pci_resource_len(pdev, bar));
-	if (!qdev->addr) {
-		kfree(qdev);
-		return NULL;
+	len = pci_resource_len(pdev, bar);
+	if (len <= QDMA_OFFSET_DMAP_SEL_INTR_CIDX) {
+		dev_err(&pdev->dev, "BAR %d too small for QDMA registers", bar);
+		goto free_qdev;
 	}
 
+	/* Two disjoint mappings, so that no page of the BAR is mapped with
+	 * conflicting memory types
+	 */
+	qdev->addr = pci_iomap_range(pdev, bar, 0,
+				     QDMA_OFFSET_DMAP_SEL_INTR_CIDX);
+	if (!qdev->addr)
+		goto free_qdev;
+
+	qdev->db_addr = pci_iomap_wc_range(pdev, bar,
+					   QDMA_OFFSET_DMAP_SEL_INTR_CIDX,
+					   min_t(resource_size_t,
+						 QDMA_DMAP_SEL_SIZE,
+						 len - QDMA_OFFSET_DMAP_SEL_INTR_CIDX));
+	if (!qdev->db_addr)
+		goto unmap_regs;
+
 	return qdev;
+
+unmap_regs:
+	pci_iounmap(pdev, qdev->addr);
+free_qdev:
+	kfree(qdev);
+	return NULL;
 }
 
 void qdma_destroy_dev(struct qdma_dev *qdev)
@@ -46,6 +70,7 @@ void qdma_destroy_dev(struct qdma_dev *qdev)
 	if (!qdev)
 		return;
 
+	pci_iounmap(qdev->pdev, qdev->db_addr);
 	pci_iounmap(qdev->pdev, qdev->addr);
 	kfree(qdev);
 }
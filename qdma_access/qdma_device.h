@@ -27,6 +27,7 @@ struct qdma_dev {
 	u16 q_base;
 	u16 num_queues;
 	void __iomem *addr;	/* mappaed address of device registers */
+	void __iomem *db_addr;	/* write-combining mapping of the DMAP_SEL doorbells */
 };
 
 /**
@@ -34,6 +35,9 @@ struct qdma_dev {
  * @pdev: pointer to PCI device
  * @bar: BAR number for QDMA registers
  *
+ * The BAR is mapped in two pieces: the registers below the DMAP_SEL region
+ * uncached, and the DMAP_SEL doorbell pages write-combining.
+ *
  * Return a pointer to the created QDMA devcie, or NULL on failure
  **/
 struct qdma_dev *qdma_create_dev(struct pci_dev *pdev, u8 bar);
@@ -19,6 +19,8 @@
 
 #include <linux/types.h>
 #include <linux/bitops.h>
+#include <linux/bitfield.h>
+#include <linux/compiler.h>
 
 #define QDMA_NUM_DESC_RNGCNT		16
 #define QDMA_NUM_C2H_BUFSZ		16
@@ -59,10 +61,20 @@ enum qdma_wb_intvl {
 #define QDMA_H2C_ST_DESC_SIZE                   16
 #define QDMA_H2C_ST_DESC_DW0_METADATA_MASK      GENMASK_ULL(31, 0)
 #define QDMA_H2C_ST_DESC_DW0_LEN_MASK           GENMASK_ULL(47, 32)
+#define QDMA_H2C_ST_DESC_DW0_SOP_MASK           GENMASK_ULL(49, 49)
+#define QDMA_H2C_ST_DESC_DW0_EOP_MASK           GENMASK_ULL(50, 50)
 
+/**
+ * struct qdma_h2c_st_desc - H2C stream descriptor
+ *
+ * A packet spans the descriptors from the one with @sop set up to the one with
+ * @eop set.  Only the metadata of the first descriptor reaches the user logic.
+ **/
 struct qdma_h2c_st_desc {
 	u32 metadata;
 	u16 len;
+	u8 sop;
+	u8 eop;
 	u64 src_addr;
 };
 
@@ -111,12 +123,60 @@ struct qdma_c2h_cmpl_stat {
  * These helper functions are used to convert between C structure and bit
  * streams.  Packing functions take C structure and write its content in proper
  * bit stream format.  Unpacking functions perform the opposite.
+ *
+ * They run for every descriptor and completion, so they are inlined and only
+ * use constant masks: each field is a shift and a mask.  Unpacking reads
+ * memory written by the device, once, with READ_ONCE() so that polling loops
+ * always see a fresh value.
  **/
-void qdma_pack_h2c_st_desc(u8 *data, struct qdma_h2c_st_desc *desc);
-void qdma_pack_c2h_st_desc(u8 *data, struct qdma_c2h_st_desc *desc);
-void qdma_unpack_wb_stat(struct qdma_wb_stat *stat, u8 *data);
-void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl, u8 *data);
-void qdma_unpack_c2h_cmpl_stat(struct qdma_c2h_cmpl_stat *stat, u8 *data);
+static inline void qdma_pack_h2c_st_desc(u8 *data,
+					 const struct qdma_h2c_st_desc *desc)
+{
+	u64 *dw = (u64 *)data;
+
+	dw[0] = FIELD_PREP(QDMA_H2C_ST_DESC_DW0_METADATA_MASK, desc->metadata) |
+		FIELD_PREP(QDMA_H2C_ST_DESC_DW0_LEN_MASK, desc->len) |
+		FIELD_PREP(QDMA_H2C_ST_DESC_DW0_SOP_MASK, desc->sop) |
+		FIELD_PREP(QDMA_H2C_ST_DESC_DW0_EOP_MASK, desc->eop);
+	dw[1] = desc->src_addr;
+}
+
+static inline void qdma_pack_c2h_st_desc(u8 *data,
+					 const struct qdma_c2h_st_desc *desc)
+{
+	*(u64 *)data = desc->dst_addr;
+}
+
+static inline void qdma_unpack_wb_stat(struct qdma_wb_stat *stat,
+				       const u8 *data)
+{
+	u64 dw = READ_ONCE(*(const u64 *)data);
+
+	stat->pidx = FIELD_GET(QDMA_WB_STAT_DW_PIDX_MASK, dw);
+	stat->cidx = FIELD_GET(QDMA_WB_STAT_DW_CIDX_MASK, dw);
+}
+
+static inline void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl,
+					const u8 *data)
+{
+	u64 dw = READ_ONCE(*(const u64 *)data);
+
+	cmpl->color = FIELD_GET(QDMA_C2H_CMPL_DW_COLOR_MASK, dw);
+	cmpl->err = FIELD_GET(QDMA_C2H_CMPL_DW_ERR_MASK, dw);
+	cmpl->pkt_len = FIELD_GET(QDMA_C2H_CMPL_DW_PKT_LEN_MASK, dw);
+	cmpl->pkt_id = FIELD_GET(QDMA_C2H_CMPL_DW_PKT_ID_MASK, dw);
+}
+
+static inline void qdma_unpack_c2h_cmpl_stat(struct qdma_c2h_cmpl_stat *stat,
+					     const u8 *data)
+{
+	u64 dw = READ_ONCE(*(const u64 *)data);
+
+	stat->pidx = FIELD_GET(QDMA_C2H_CMPL_STAT_DW_PIDX_MASK, dw);
+	stat->cidx = FIELD_GET(QDMA_C2H_CMPL_STAT_DW_CIDX_MASK, dw);
+	stat->color = FIELD_GET(QDMA_C2H_CMPL_STAT_DW_COLOR_MASK, dw);
+	stat->intr_state = FIELD_GET(QDMA_C2H_CMPL_STAT_DW_INTR_STATE_MASK, dw);
+}
 
 enum qdma_error_index {
 	/* descriptor errors */
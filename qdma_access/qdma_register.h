@@ -45,6 +45,32 @@ static inline void qdma_write_reg(struct qdma_dev *qdev, u32 offset, u32 val)
 	iowrite32(val, qdev->addr + offset);
 }
 
+/**
+ * qdma_write_db - Write value to a QDMA DMAP_SEL doorbell register
+ * @qdev: pointer to QDMA device
+ * @offset: register offset, QDMA_OFFSET_DMAP_SEL_* plus the queue stride
+ * @val: value to be written
+ *
+ * The doorbell pages are mapped write-combining, and a write-combining store
+ * is not ordered against earlier stores to the descriptor rings: the wmb()
+ * makes the descriptors visible before the doorbell.
+ *
+ * The write-combining buffer is not drained after the doorbell, so that
+ * back-to-back doorbells, such as the C2H PIDX and CMPL CIDX of an RX poll,
+ * go out together.  A doorbell left in the buffer is only delayed, never
+ * lost: the wmb() of the next doorbell drains it, as do, on x86, the locked
+ * instructions and interrupts that the NAPI and timer paths run into right
+ * after, and the buffer is otherwise evicted on its own.  Each doorbell
+ * carries a whole index, so one overtaken by a later write to the same
+ * register loses nothing.
+ **/
+static inline void qdma_write_db(struct qdma_dev *qdev, u32 offset, u32 val)
+{
+	wmb();
+	writel_relaxed(val, qdev->db_addr +
+		       (offset - QDMA_OFFSET_DMAP_SEL_INTR_CIDX));
+}
+
 /* ------------------------- QDMA_TRQ_SEL_IND (0x00800) ----------------*/
 #define QDMA_OFFSET_IND_CTXT_DATA                           0x804
 #define QDMA_OFFSET_IND_CTXT_MASK                           0x824
@@ -265,6 +291,9 @@ static inline void qdma_write_reg(struct qdma_dev *qdev, u32 offset, u32 val)
 #define QDMA_OFFSET_DMAP_SEL_H2C_DESC_PIDX                  0x18004
 #define QDMA_OFFSET_DMAP_SEL_C2H_DESC_PIDX                  0x18008
 #define QDMA_OFFSET_DMAP_SEL_CMPL_CIDX                      0x1800C
+/* 16 bytes of doorbells per queue, for up to 2048 queues */
+#define QDMA_DMAP_SEL_QUEUE_STRIDE                          16
+#define QDMA_DMAP_SEL_SIZE                                  0x8000
 
 #define QDMA_OFFSET_VF_DMAP_SEL_INTR_CIDX                   0x3000
 #define QDMA_OFFSET_VF_DMAP_SEL_H2C_DESC_PIDX               0x3004